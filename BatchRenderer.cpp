@@ -0,0 +1,388 @@
+#include "BatchRenderer.hpp"
+
+//for the GL_ERRORS() macro:
+#include "gl_errors.hpp"
+
+//for cached GL binding:
+#include "gl_state.hpp"
+
+//for CPU timing zones:
+#include "trace_zones.hpp"
+
+//for the debug HUD:
+#include "counters.hpp"
+
+//for generating vertices in parallel:
+#include "JobSystem.hpp"
+
+//for glm::value_ptr() :
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+// Frames with fewer vertices than this are generated on the calling thread only
+#define PARALLEL_DRAW_MIN_VERTICES 16384
+
+#define TWO_PI 6.28318531f
+
+BatchRenderer *batch_renderer = nullptr;
+
+static Counter &vertices_emitted = counters.add("vertices");
+static Counter &bytes_uploaded = counters.add("bytes uploaded");
+static Counter &draw_calls = counters.add("draw calls");
+
+BatchRenderer::BatchRenderer() {
+	//----- allocate OpenGL resources -----
+	{ //vertex buffer:
+		glGenBuffers(1, &vertex_buffer);
+		//for now, buffer will be un-filled.
+
+		GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
+	}
+
+	{ //vertex array mapping buffer for color_texture_program:
+		//ask OpenGL to fill vertex_buffer_for_color_texture_program with the name of an unused vertex array object:
+		glGenVertexArrays(1, &vertex_buffer_for_color_texture_program);
+
+		//set vertex_buffer_for_color_texture_program as the current vertex array object:
+		gl_state.bind_vertex_array(vertex_buffer_for_color_texture_program);
+
+		//set vertex_buffer as the source of glVertexAttribPointer() commands:
+		gl_state.bind_buffer(GL_ARRAY_BUFFER, vertex_buffer);
+
+		//set up the vertex array object to describe arrays of BatchRenderer::Vertex:
+		glVertexAttribPointer(
+			color_texture_program.Position_vec4, //attribute
+			3, //size
+			GL_FLOAT, //type
+			GL_FALSE, //normalized
+			sizeof(Vertex), //stride
+			(GLbyte *)0 + 0 //offset
+		);
+		glEnableVertexAttribArray(color_texture_program.Position_vec4);
+		//[Note that it is okay to bind a vec3 input to a vec4 attribute -- the w component will be filled with 1.0 automatically]
+
+		glVertexAttribPointer(
+			color_texture_program.Color_vec4, //attribute
+			4, //size
+			GL_UNSIGNED_BYTE, //type
+			GL_TRUE, //normalized
+			sizeof(Vertex), //stride
+			(GLbyte *)0 + 4*3 //offset
+		);
+		glEnableVertexAttribArray(color_texture_program.Color_vec4);
+
+		glVertexAttribPointer(
+			color_texture_program.TexCoord_vec2, //attribute
+			2, //size
+			GL_FLOAT, //type
+			GL_FALSE, //normalized
+			sizeof(Vertex), //stride
+			(GLbyte *)0 + 4*3 + 4*1 //offset
+		);
+		glEnableVertexAttribArray(color_texture_program.TexCoord_vec2);
+
+		//done referring to vertex_buffer, so unbind it:
+		gl_state.bind_buffer(GL_ARRAY_BUFFER, 0);
+
+		//done setting up vertex array object, so unbind it:
+		gl_state.bind_vertex_array(0);
+
+		GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
+	}
+
+	{ //solid white texture:
+		//ask OpenGL to fill white_tex with the name of an unused texture object:
+		glGenTextures(1, &white_tex);
+
+		//bind that texture object as a GL_TEXTURE_2D-type texture:
+		gl_state.bind_texture(GL_TEXTURE_2D, white_tex);
+
+		//upload a 1x1 image of solid white to the texture:
+		glm::uvec2 size = glm::uvec2(1,1);
+		std::vector< glm::u8vec4 > data(size.x*size.y, glm::u8vec4(0xff, 0xff, 0xff, 0xff));
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+
+		//set filtering and wrapping parameters:
+		//(it's a bit silly to mipmap a 1x1 texture, but I'm doing it because you may want to use this code to load different sizes of texture)
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+		//since texture uses a mipmap and we haven't uploaded one, instruct opengl to make one for us:
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+		//Okay, texture uploaded, can unbind it:
+		gl_state.bind_texture(GL_TEXTURE_2D, 0);
+
+		GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
+	}
+}
+
+BatchRenderer::~BatchRenderer() {
+
+	//----- free OpenGL resources -----
+	gl_state.deleted_buffer(vertex_buffer);
+	glDeleteBuffers(1, &vertex_buffer);
+	vertex_buffer = 0;
+
+	gl_state.deleted_vertex_array(vertex_buffer_for_color_texture_program);
+	glDeleteVertexArrays(1, &vertex_buffer_for_color_texture_program);
+	vertex_buffer_for_color_texture_program = 0;
+
+	gl_state.deleted_texture(white_tex);
+	glDeleteTextures(1, &white_tex);
+	white_tex = 0;
+}
+
+void BatchRenderer::begin(glm::mat4 const &object_to_clip_, glm::uvec2 const &drawable_size) {
+	object_to_clip = object_to_clip_;
+
+	//clip space is two units tall, so this is drawable pixels per object-space unit
+	// (assuming, as in all the modes, that object space is uniformly scaled):
+	pixels_per_unit = std::abs(object_to_clip[1][1]) * 0.5f * drawable_size.y;
+
+	shapes.clear();
+	states.clear();
+	state = State();
+	state_recorded = false;
+}
+
+void BatchRenderer::set_layer(uint8_t layer) {
+	if (layer == state.layer) return;
+	state.layer = layer;
+	state_recorded = false;
+}
+
+void BatchRenderer::set_program(ColorTextureProgram const *program) {
+	if (program == state.program) return;
+	state.program = program;
+	state_recorded = false;
+}
+
+void BatchRenderer::set_texture(GLuint texture) {
+	if (texture == state.texture) return;
+	state.texture = texture;
+	state_recorded = false;
+}
+
+void BatchRenderer::set_blend(Blend blend) {
+	if (blend == state.blend) return;
+	state.blend = blend;
+	state_recorded = false;
+}
+
+BatchRenderer::Shape &BatchRenderer::add_shape(Shape::Kind kind) {
+	if (!state_recorded) {
+		//reuse an identical state from earlier in the frame, if there is one:
+		current_state = uint32_t(states.size());
+		for (uint32_t i = 0; i < states.size(); ++i) {
+			State const &s = states[i];
+			if (s.layer == state.layer && s.blend == state.blend && s.program == state.program && s.texture == state.texture) {
+				current_state = i;
+				break;
+			}
+		}
+		if (current_state == states.size()) states.emplace_back(state);
+		state_recorded = true;
+	}
+
+	shapes.emplace_back();
+	Shape &shape = shapes[shapes.size() - 1];
+	shape.kind = kind;
+	shape.state = current_state;
+	return shape;
+}
+
+void BatchRenderer::quad(glm::vec2 const &center, glm::vec2 const &radius, glm::u8vec4 const &color) {
+	Shape &shape = add_shape(Shape::Quad);
+	shape.center = center;
+	shape.radius = radius;
+	shape.color = color;
+}
+
+void BatchRenderer::circle(glm::vec2 const &center, float radius, glm::u8vec4 const &color) {
+	Shape &shape = add_shape(Shape::Disc);
+	shape.center = center;
+	shape.radius = glm::vec2(0.0f, radius);
+	shape.color = color;
+	//(at least three segments, even for tiny circles)
+	shape.steps = arc_steps(TWO_PI, std::min(TWO_PI / 3.0f, arc_max_step(radius * pixels_per_unit, max_chord_error)));
+}
+
+void BatchRenderer::sector(glm::vec2 const &center, glm::vec2 const &radius, glm::vec2 const &angles, glm::u8vec4 const &color) {
+	Shape &shape = add_shape(Shape::Sector);
+	shape.center = center;
+	shape.radius = radius;
+	shape.angles = angles;
+	shape.color = color;
+	//the outer edge is the longest, so it decides the tessellation:
+	shape.steps = arc_steps(angles.y - angles.x, arc_max_step(radius.y * pixels_per_unit, max_chord_error));
+}
+
+size_t BatchRenderer::vertex_count(Shape const &shape) const {
+	switch (shape.kind) {
+	case Shape::Quad: return 6;
+	case Shape::Disc: return disc_vertex_count(shape.steps);
+	case Shape::Sector: return sector_vertex_count(shape.steps);
+	}
+	return 0;
+}
+
+void BatchRenderer::emit(Shape const &shape) {
+	Vertex *out = vertices.data() + shape.first_vertex;
+	if (shape.kind == Shape::Disc) {
+		emit_disc(out, shape.center, shape.radius.y, shape.steps, shape.color);
+	} else if (shape.kind == Shape::Sector) {
+		emit_sector(out, shape.center, shape.radius, shape.angles, shape.steps, shape.color);
+	} else {
+		glm::vec2 const &center = shape.center;
+		glm::vec2 const &radius = shape.radius;
+		glm::u8vec4 const &color = shape.color;
+		//draw rectangle as two CCW-oriented triangles:
+		out[0] = Vertex(glm::vec3(center.x-radius.x, center.y-radius.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
+		out[1] = Vertex(glm::vec3(center.x+radius.x, center.y-radius.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
+		out[2] = Vertex(glm::vec3(center.x+radius.x, center.y+radius.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
+
+		out[3] = Vertex(glm::vec3(center.x-radius.x, center.y-radius.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
+		out[4] = Vertex(glm::vec3(center.x+radius.x, center.y+radius.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
+		out[5] = Vertex(glm::vec3(center.x-radius.x, center.y+radius.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
+	}
+}
+
+void BatchRenderer::flush() {
+	TRACE_ZONE("BatchRenderer::flush");
+
+	//---- sort shapes by state ----
+
+	//rank the (few) distinct states used this frame:
+	uint32_t state_count = uint32_t(states.size());
+	uint32_t *order = frame_arena.alloc< uint32_t >(state_count);
+	uint32_t *rank = frame_arena.alloc< uint32_t >(state_count);
+	for (uint32_t i = 0; i < state_count; ++i) {
+		order[i] = i;
+	}
+	auto state_less = [this](uint32_t a, uint32_t b) {
+		State const &sa = states[a];
+		State const &sb = states[b];
+		if (sa.layer != sb.layer) return sa.layer < sb.layer;
+		if (sa.program != sb.program) return std::less< ColorTextureProgram const * >()(sa.program, sb.program);
+		if (sa.texture != sb.texture) return sa.texture < sb.texture;
+		return sa.blend < sb.blend;
+	};
+	//(insertion sort -- there are only ever a handful of states)
+	for (uint32_t i = 1; i < state_count; ++i) {
+		for (uint32_t j = i; j > 0 && state_less(order[j], order[j-1]); --j) {
+			std::swap(order[j], order[j-1]);
+		}
+	}
+	for (uint32_t i = 0; i < state_count; ++i) {
+		rank[order[i]] = i;
+	}
+
+	//recording order breaks ties, so the (in-place) sort is stable:
+	for (uint32_t i = 0; i < shapes.size(); ++i) {
+		shapes[i].sort_key = (uint64_t(rank[shapes[i].state]) << 32) | i;
+	}
+	std::sort(shapes.items.begin(), shapes.items.end(), [](Shape const &a, Shape const &b) {
+		return a.sort_key < b.sort_key;
+	});
+
+	//---- generate vertices ----
+
+	size_t total = 0;
+	for (uint32_t i = 0; i < shapes.size(); ++i) {
+		shapes[i].first_vertex = total;
+		total += vertex_count(shapes[i]);
+	}
+	vertices.resize(total);
+
+	if (total >= PARALLEL_DRAW_MIN_VERTICES && jobs && jobs->thread_count() > 1) {
+		//split the shapes into contiguous chunks of roughly equal vertex counts;
+		// each chunk fills its own slice of the vertex buffer:
+		uint32_t chunk_count = jobs->thread_count();
+		uint32_t *chunk_begin = frame_arena.alloc< uint32_t >(chunk_count + 1);
+		uint32_t shape = 0;
+		for (uint32_t c = 0; c < chunk_count; ++c) {
+			chunk_begin[c] = shape;
+			size_t chunk_end_vertex = total * (c + 1) / chunk_count;
+			while (shape < shapes.size() && shapes[shape].first_vertex < chunk_end_vertex) ++shape;
+		}
+		chunk_begin[chunk_count] = uint32_t(shapes.size());
+
+		jobs->parallel_for(chunk_count, [&](uint32_t c) {
+			TRACE_ZONE("emit vertices");
+			for (uint32_t i = chunk_begin[c]; i < chunk_begin[c+1]; ++i) {
+				emit(shapes[i]);
+			}
+		});
+	} else {
+		for (uint32_t i = 0; i < shapes.size(); ++i) {
+			emit(shapes[i]);
+		}
+	}
+
+	//---- actual drawing ----
+	//(all binding goes through gl_state, which skips anything that is already bound)
+
+	//don't use the depth test:
+	gl_state.disable(GL_DEPTH_TEST);
+
+	//upload vertices to vertex_buffer:
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, vertex_buffer); //set vertex_buffer as current
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STREAM_DRAW); //upload vertices array
+	vertices_emitted.add(vertices.size());
+	bytes_uploaded.add(vertices.size() * sizeof(vertices[0]));
+
+	//use the mapping vertex_buffer_for_color_texture_program to fetch vertex data:
+	gl_state.bind_vertex_array(vertex_buffer_for_color_texture_program);
+
+	//textures are always bound to location zero:
+	gl_state.active_texture(GL_TEXTURE0);
+
+	//one draw call per run of shapes that share a state:
+	uint32_t run_begin = 0;
+	ColorTextureProgram const *last_program = nullptr;
+	while (run_begin < shapes.size()) {
+		uint32_t run_end = run_begin + 1;
+		while (run_end < shapes.size() && shapes[run_end].state == shapes[run_begin].state) ++run_end;
+
+		State const &s = states[shapes[run_begin].state];
+
+		ColorTextureProgram const *program = (s.program ? s.program : &color_texture_program);
+		gl_state.use_program(program->program);
+		if (program != last_program) {
+			//upload OBJECT_TO_CLIP to the proper uniform location:
+			glUniformMatrix4fv(program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+			last_program = program;
+		}
+
+		gl_state.bind_texture(GL_TEXTURE_2D, (s.texture ? s.texture : white_tex));
+
+		if (s.blend == BlendAlpha) {
+			gl_state.enable(GL_BLEND);
+			gl_state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		} else {
+			gl_state.disable(GL_BLEND);
+		}
+
+		//run the OpenGL pipeline:
+		size_t first = shapes[run_begin].first_vertex;
+		size_t count = (run_end < shapes.size() ? shapes[run_end].first_vertex : total) - first;
+		glDrawArrays(GL_TRIANGLES, GLint(first), GLsizei(count));
+		draw_calls.add(1);
+
+		run_begin = run_end;
+	}
+
+	//(bindings are left in place -- next frame, gl_state will skip re-binding them)
+
+	GL_ERRORS(); //PARANOIA: print errors just in case we did something wrong.
+
+	//shapes are drawn; the next frame starts with begin():
+	shapes.clear();
+	states.clear();
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "ColorTextureProgram.hpp"
+#include "FrameArena.hpp"
+#include "arc_vertices.hpp"
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+/*
+ * BatchRenderer draws colored 2D shapes (quads, discs, and annular sectors)
+ *  with as few draw calls as possible. It owns the GL objects every mode needs,
+ *  so switching modes doesn't re-create them.
+ *
+ * Shapes are recorded between begin() and flush(). flush() sorts them by
+ *  render state (layer, program, texture, blend), generates all of their
+ *  vertices into one buffer, and issues one glDrawArrays per run of equal state.
+ * Shapes with equal state keep their recorded order; use layers when the
+ *  overlap order between shapes with different state matters.
+ */
+
+struct BatchRenderer {
+	BatchRenderer();
+	~BatchRenderer();
+	BatchRenderer(BatchRenderer const &) = delete;
+	BatchRenderer &operator=(BatchRenderer const &) = delete;
+
+	enum Blend : uint8_t {
+		BlendOpaque,
+		BlendAlpha, //GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+	};
+
+	//----- recording -----
+
+	//start a new draw list; every shape in it is transformed by object_to_clip,
+	// and curved shapes are tessellated for the given drawable size:
+	void begin(glm::mat4 const &object_to_clip, glm::uvec2 const &drawable_size);
+
+	//render state for shapes recorded after the call (reset by begin()):
+	void set_layer(uint8_t layer); //lower layers draw first (default 0)
+	void set_program(ColorTextureProgram const *program); //nullptr for the built-in program
+	void set_texture(GLuint texture); //0 for solid white
+	void set_blend(Blend blend); //default BlendAlpha
+
+	void quad(glm::vec2 const &center, glm::vec2 const &radius, glm::u8vec4 const &color);
+	void circle(glm::vec2 const &center, float radius, glm::u8vec4 const &color);
+	//annular sector between radius.x and radius.y, from angles.x to angles.y (radians):
+	void sector(glm::vec2 const &center, glm::vec2 const &radius, glm::vec2 const &angles, glm::u8vec4 const &color);
+
+	//sort, generate, upload, and draw everything recorded since begin():
+	void flush();
+
+	//largest allowed distance (in drawable pixels) between a curved edge and the
+	// straight segments used to draw it:
+	float max_chord_error = 0.5f;
+
+	//----- opengl assets (shared by all modes) -----
+
+	struct Vertex {
+		//(user-provided and empty, so vertices.resize() leaves new elements unwritten instead of zeroing them)
+		Vertex() { }
+		Vertex(glm::vec3 const &Position_, glm::u8vec4 const &Color_, glm::vec2 const &TexCoord_) :
+			Position(Position_), Color(Color_), TexCoord(TexCoord_) { }
+		glm::vec3 Position;
+		glm::u8vec4 Color;
+		glm::vec2 TexCoord;
+	};
+	static_assert(sizeof(Vertex) == 4*3 + 1*4 + 4*2, "BatchRenderer::Vertex should be packed");
+	//(arc_vertices.hpp writes this layout directly)
+
+	//Shader program that draws transformed, vertices tinted with vertex colors:
+	// (programs passed to set_program must use the same attribute locations)
+	ColorTextureProgram color_texture_program;
+
+	//Buffer used to hold vertex data during drawing:
+	GLuint vertex_buffer = 0;
+
+	//Vertex Array Object that maps buffer locations to color_texture_program attribute locations:
+	GLuint vertex_buffer_for_color_texture_program = 0;
+
+	//Solid white texture:
+	GLuint white_tex = 0;
+
+private:
+	struct State {
+		uint8_t layer = 0;
+		Blend blend = BlendAlpha;
+		ColorTextureProgram const *program = nullptr;
+		GLuint texture = 0;
+	};
+
+	struct Shape {
+		enum Kind : uint8_t { Quad, Disc, Sector } kind;
+		uint32_t state; //index into 'states'
+		uint64_t sort_key; //(state rank << 32) | recording order, filled in by flush()
+		glm::vec2 center;
+		glm::vec2 radius; //half-size for quads; (inner, outer) for sectors; discs use radius.y
+		glm::vec2 angles;
+		glm::u8vec4 color;
+		ArcSteps steps;
+		size_t first_vertex;
+	};
+
+	Shape &add_shape(Shape::Kind kind);
+	size_t vertex_count(Shape const &shape) const;
+	void emit(Shape const &shape);
+
+	glm::mat4 object_to_clip = glm::mat4(1.0f);
+	float pixels_per_unit = 1.0f;
+
+	State state; //applied to newly recorded shapes
+	bool state_recorded = false; //is 'state' already states[current_state]?
+	uint32_t current_state = 0;
+
+	//retained between frames, so steady-state frames don't allocate:
+	ScratchBuffer< State > states;
+	ScratchBuffer< Shape > shapes;
+	ScratchBuffer< Vertex > vertices;
+};
+
+//The renderer shared by all modes; created by main() once the GL context exists:
+extern BatchRenderer *batch_renderer;
@@ -0,0 +1,113 @@
+#include "DebugHUD.hpp"
+
+#include "BatchRenderer.hpp"
+#include "GPUProfiler.hpp"
+#include "counters.hpp"
+#include "pixel_text.hpp"
+#include "trace_zones.hpp"
+
+//for the GL_ERRORS() macro:
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+
+DebugHUD debug_hud;
+
+void DebugHUD::draw(glm::uvec2 const &drawable_size) {
+	//frame time is measured draw-to-draw, even while hidden, so the sparkline is full when shown:
+	auto now = std::chrono::steady_clock::now();
+	if (drawn_before) {
+		frame_ms[next_frame] = std::chrono::duration< float, std::milli >(now - last_draw).count();
+		next_frame = (next_frame + 1) % SparklineFrames;
+	}
+	last_draw = now;
+	drawn_before = true;
+
+	if (!show || !batch_renderer) return;
+
+	TRACE_ZONE("DebugHUD::draw");
+	GPUProfiler::Scope pass("hud");
+
+	//layout, in drawable pixels (text scale grows with the window):
+	const float scale = std::max(2.0f, std::floor(drawable_size.y / 360.0f));
+	const float margin = 4.0f * scale;
+	const float line_height = PixelTextLineHeight * scale;
+	const uint32_t columns = 28; //characters per line
+	const float width = pixel_text_width(scale, "x") * columns;
+	const float sparkline_height = 12.0f * scale;
+	const float budget_ms = 1000.0f / 60.0f; //sparkline reference line
+	const float sparkline_ms = 2.0f * budget_ms; //sparkline full height
+
+	const glm::u8vec4 text_color(0xf0, 0xf0, 0xf0, 0xff);
+	const glm::u8vec4 backdrop_color(0x00, 0x00, 0x00, 0xa0);
+	const glm::u8vec4 fast_color(0x8c, 0xd6, 0x4b, 0xff);
+	const glm::u8vec4 slow_color(0xf2, 0x6b, 0x3a, 0xff);
+
+	//maps drawable pixels (origin lower left) to clip space:
+	glm::mat4 pixel_to_clip(
+		glm::vec4(2.0f / drawable_size.x, 0.0f, 0.0f, 0.0f),
+		glm::vec4(0.0f, 2.0f / drawable_size.y, 0.0f, 0.0f),
+		glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
+		glm::vec4(-1.0f, -1.0f, 0.0f, 1.0f)
+	);
+
+	batch_renderer->begin(pixel_to_clip, drawable_size);
+
+	uint32_t lines = 1;
+	for (uint32_t i = 0; i < counters.size(); ++i) {
+		if (counters[i].ready.load(std::memory_order_acquire)) lines += 1;
+	}
+
+	glm::vec2 min(drawable_size.x - width - 3.0f * margin, drawable_size.y - margin - (lines * line_height + sparkline_height + 3.0f * margin));
+	glm::vec2 max(drawable_size.x - margin, drawable_size.y - margin);
+
+	batch_renderer->set_layer(0);
+	batch_renderer->quad(0.5f * (min + max), 0.5f * (max - min), backdrop_color);
+
+	batch_renderer->set_layer(1);
+	glm::vec2 at(min.x + margin, max.y - margin);
+	char line[64];
+
+	{ //frame time summary:
+		float latest = frame_ms[(next_frame + SparklineFrames - 1) % SparklineFrames];
+		float worst = *std::max_element(frame_ms, frame_ms + SparklineFrames);
+		std::snprintf(line, sizeof(line), "frame %5.1f ms  max %5.1f", latest, worst);
+		draw_pixel_text(at, scale, line, text_color);
+		at.y -= line_height;
+	}
+
+	for (uint32_t i = 0; i < counters.size(); ++i) {
+		Counter const &counter = counters[i];
+		if (!counter.ready.load(std::memory_order_acquire)) continue;
+		std::snprintf(line, sizeof(line), "%-18.18s%10" PRIu64, counter.name, counter.last_frame);
+		draw_pixel_text(at, scale, line, text_color);
+		at.y -= line_height;
+	}
+
+	{ //sparkline, oldest frame on the left:
+		float bar_width = (width + margin) / SparklineFrames;
+		float base = min.y + margin;
+		for (uint32_t i = 0; i < SparklineFrames; ++i) {
+			float ms = frame_ms[(next_frame + i) % SparklineFrames];
+			float height = std::max(1.0f, std::min(1.0f, ms / sparkline_ms) * sparkline_height);
+			batch_renderer->quad(
+				glm::vec2(min.x + margin + (i + 0.5f) * bar_width, base + 0.5f * height),
+				glm::vec2(0.5f * bar_width, 0.5f * height),
+				(ms <= budget_ms + 0.5f ? fast_color : slow_color)
+			);
+		}
+		batch_renderer->set_layer(2);
+		batch_renderer->quad(
+			glm::vec2(min.x + margin + 0.5f * (width + margin), base + (budget_ms / sparkline_ms) * sparkline_height),
+			glm::vec2(0.5f * (width + margin), 0.5f),
+			glm::u8vec4(0xff, 0xff, 0xff, 0x80)
+		);
+	}
+
+	batch_renderer->flush();
+
+	GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
+}
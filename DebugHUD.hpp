@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <stdint.h>
+
+/*
+ * DebugHUD shows last frame's value of every counter in the registry
+ *  (counters.hpp) and a sparkline of recent frame times, in the upper right
+ *  corner. It draws through batch_renderer, after the mode has drawn.
+ */
+
+struct DebugHUD {
+	//records the time since the last call, then draws (if 'show' is set):
+	void draw(glm::uvec2 const &drawable_size);
+	bool show = false;
+
+	enum : uint32_t { SparklineFrames = 120 };
+
+private:
+	float frame_ms[SparklineFrames] = { };
+	uint32_t next_frame = 0; //index into frame_ms
+	std::chrono::steady_clock::time_point last_draw;
+	bool drawn_before = false;
+};
+
+extern DebugHUD debug_hud;
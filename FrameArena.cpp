@@ -0,0 +1,62 @@
+#include "FrameArena.hpp"
+
+//for the debug HUD:
+#include "counters.hpp"
+
+#include <cassert>
+#include <new>
+
+FrameArena frame_arena;
+
+static Counter &scratch_heap_allocations = counters.add("scratch heap allocs");
+
+FrameArena::FrameArena(size_t initial_bytes) {
+	block = static_cast< uint8_t * >(::operator new(initial_bytes));
+	block_size = initial_bytes;
+}
+
+FrameArena::~FrameArena() {
+	for (void *o : overflow) {
+		::operator delete(o);
+	}
+	::operator delete(block);
+}
+
+void FrameArena::reset() {
+	if (!overflow.empty()) {
+		//last frame didn't fit; grow the block so that it will next time:
+		for (void *o : overflow) {
+			::operator delete(o);
+		}
+		overflow.clear();
+
+		size_t new_size = block_size;
+		while (new_size < used + overflow_bytes) new_size *= 2;
+
+		::operator delete(block);
+		block = static_cast< uint8_t * >(::operator new(new_size));
+		block_size = new_size;
+		heap_allocations += 1;
+	}
+	used = 0;
+	overflow_bytes = 0;
+	scratch_heap_allocations.add(frame_heap_allocations);
+	frame_heap_allocations = 0;
+}
+
+void *FrameArena::alloc_bytes(size_t bytes, size_t align) {
+	assert(align != 0 && (align & (align - 1)) == 0 && align <= alignof(std::max_align_t));
+
+	size_t offset = (used + (align - 1)) & ~(align - 1);
+	if (offset + bytes <= block_size) {
+		used = offset + bytes;
+		return block + offset;
+	}
+
+	//out of room -- fall back to the heap for the rest of the frame:
+	void *ret = ::operator new(bytes);
+	overflow.emplace_back(ret);
+	overflow_bytes += bytes + align;
+	count_heap_allocation();
+	return ret;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+#include <stdint.h>
+
+/*
+ * FrameArena is a linear ("bump") allocator for data that only lives for one frame.
+ * Allocations advance an offset into a retained block; reset() rewinds it.
+ * If a frame asks for more than the block holds, the excess comes from the heap
+ *  and the block is grown at the next reset(), so steady-state frames never allocate.
+ */
+
+struct FrameArena {
+	FrameArena(size_t initial_bytes = 64 * 1024);
+	~FrameArena();
+	FrameArena(FrameArena const &) = delete;
+	FrameArena &operator=(FrameArena const &) = delete;
+
+	//rewind the arena; called by the main loop at the start of each frame:
+	void reset();
+
+	//uninitialized storage for 'count' T's, valid until the next reset():
+	template< typename T >
+	T *alloc(size_t count) {
+		static_assert(std::is_trivially_destructible< T >::value, "FrameArena never runs destructors");
+		return reinterpret_cast< T * >(alloc_bytes(count * sizeof(T), alignof(T)));
+	}
+	void *alloc_bytes(size_t bytes, size_t align);
+
+	//heap allocations made for frame data (by the arena or any ScratchBuffer):
+	uint32_t frame_heap_allocations = 0; //during the current frame
+	uint32_t heap_allocations = 0; //since startup
+
+	void count_heap_allocation() {
+		frame_heap_allocations += 1;
+		heap_allocations += 1;
+	}
+
+private:
+	uint8_t *block = nullptr;
+	size_t block_size = 0;
+	size_t used = 0;
+
+	//blocks handed out after 'block' filled up; freed (and folded into 'block') at reset():
+	std::vector< void * > overflow;
+	size_t overflow_bytes = 0;
+};
+
+//The arena shared by all modes; reset by the main loop once per frame:
+extern FrameArena frame_arena;
+
+//ScratchBuffer is a retained, capacity-preserving array for per-frame data:
+// clear() keeps its storage, and any growth is reported to frame_arena's counters.
+template< typename T >
+struct ScratchBuffer {
+	void clear() { items.clear(); }
+
+	void reserve(size_t count) {
+		if (count > items.capacity()) {
+			frame_arena.count_heap_allocation();
+			items.reserve(count);
+		}
+	}
+
+	//resize without caring about contents (callers overwrite every element):
+	//(grows geometrically, so a size that creeps up frame by frame settles quickly)
+	void resize(size_t count) {
+		if (count > items.capacity()) reserve(std::max(count, 2 * items.capacity()));
+		items.resize(count);
+	}
+
+	template< typename... Args >
+	void emplace_back(Args&&... args) {
+		if (items.size() == items.capacity()) reserve(std::max< size_t >(64, 2 * items.capacity()));
+		items.emplace_back(std::forward< Args >(args)...);
+	}
+
+	size_t size() const { return items.size(); }
+	T *data() { return items.data(); }
+	T const *data() const { return items.data(); }
+	T &operator[](size_t i) { return items[i]; }
+	T const &operator[](size_t i) const { return items[i]; }
+
+	std::vector< T > items;
+};
@@ -0,0 +1,367 @@
+#include "FrameCapture.hpp"
+
+#include "JobSystem.hpp"
+#include "counters.hpp"
+#include "gl_state.hpp"
+#include "load_save_png.hpp"
+#include "trace_zones.hpp"
+
+//for the GL_ERRORS() macro:
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+static Counter &capture_frames = counters.add("capture frames");
+static Counter &capture_dropped = counters.add("capture dropped");
+
+FrameCapture::FrameCapture() {
+	for (auto &slot : slots) {
+		glGenBuffers(1, &slot.buffer);
+		slot.owner = this;
+	}
+	GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
+}
+
+FrameCapture::~FrameCapture() {
+	stop_recording();
+
+	//let screenshots in flight finish, too:
+	while (true) {
+		poll();
+		bool busy = false;
+		for (auto &slot : slots) {
+			if (slot.state.load(std::memory_order_relaxed) != Slot::Free) busy = true;
+		}
+		if (!busy) break;
+		std::this_thread::yield();
+	}
+
+	for (auto &slot : slots) {
+		glDeleteBuffers(1, &slot.buffer);
+		gl_state.deleted_buffer(slot.buffer);
+	}
+	GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
+}
+
+//---- capturing ----
+
+FrameCapture::Slot *FrameCapture::acquire_slot() {
+	for (uint32_t i = 0; i < MaxSlots; ++i) {
+		Slot &slot = slots[(next_slot + i) % MaxSlots];
+		if (slot.state.load(std::memory_order_relaxed) == Slot::Free) {
+			next_slot = (next_slot + i + 1) % MaxSlots;
+			return &slot;
+		}
+	}
+	return nullptr;
+}
+
+void FrameCapture::read_back(Slot &slot, glm::uvec2 const &size) {
+	slot.size = size;
+
+	//queue the copy into the pixel buffer; glReadPixels returns without waiting for it:
+	gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	GLsizeiptr bytes = GLsizeiptr(size.x) * size.y * 4;
+	if (slot.buffer_size != bytes) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+		slot.buffer_size = bytes;
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glReadBuffer(GL_BACK);
+	glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.state.store(Slot::Reading, std::memory_order_relaxed);
+
+	GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
+}
+
+bool FrameCapture::screenshot(glm::uvec2 const &size, std::string const &filename) {
+	TRACE_ZONE("screenshot readback");
+
+	//(two encodes writing the same file at once would interleave their output)
+	for (auto const &slot : slots) {
+		if (slot.state.load(std::memory_order_relaxed) != Slot::Free && slot.sequence == ~uint64_t(0) && slot.filename == filename) {
+			std::cerr << "Still saving '" << filename << "'; skipping screenshot." << std::endl;
+			return false;
+		}
+	}
+
+	Slot *slot = acquire_slot();
+	if (!slot) {
+		std::cerr << "Still saving earlier frames; skipping screenshot '" << filename << "'." << std::endl;
+		return false;
+	}
+	slot->format = PNGSequence;
+	slot->filename = filename;
+	slot->sequence = ~uint64_t(0); //(marks a screenshot, which is announced when saved)
+	read_back(*slot, size);
+	return true;
+}
+
+void FrameCapture::frame_drawn(glm::uvec2 const &size) {
+	if (!is_recording) return;
+	TRACE_ZONE("capture readback");
+
+	if (recording_format == Y4M && recorded_frames > 0 && size != recording_size) {
+		std::cerr << "Window size changed; a Y4M stream can't change size, so recording stops." << std::endl;
+		stop_recording();
+		return;
+	}
+
+	Slot *slot = acquire_slot();
+	if (!slot && backpressure == WaitForEncoders) {
+		TRACE_ZONE("capture wait");
+		while (!(slot = acquire_slot())) {
+			poll();
+			std::this_thread::yield();
+		}
+	}
+	if (!slot) {
+		dropped_frames += 1;
+		capture_dropped.add(1);
+		if (recording_format == Y4M && recorded_frames > 0) {
+			//(a constant-rate stream keeps time by repeating the frame before the drop)
+			std::lock_guard< std::mutex > lock(y4m_mutex);
+			uint64_t before = recorded_frames - 1;
+			if (y4m_next > before) {
+				y4m_repeats += 1;
+			} else {
+				for (auto &other : slots) {
+					if (other.format == Y4M && other.sequence == before && other.state.load(std::memory_order_relaxed) != Slot::Free) {
+						other.repeats += 1;
+					}
+				}
+			}
+		}
+		return;
+	}
+
+	slot->format = recording_format;
+	if (recording_format == PNGSequence) {
+		char number[32];
+		std::snprintf(number, sizeof(number), "_%06llu.png", (unsigned long long)recorded_frames);
+		slot->filename = recording_prefix + number;
+	} else {
+		if (recorded_frames == 0) {
+			//the stream header needs the frame size, so it waits for the first frame:
+			recording_size = size;
+			std::lock_guard< std::mutex > lock(y4m_mutex);
+			y4m << "YUV4MPEG2 W" << size.x << " H" << size.y << " F" << recording_fps << ":1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n";
+		}
+	}
+	slot->sequence = recorded_frames;
+	recorded_frames += 1;
+	capture_frames.add(1);
+	read_back(*slot, size);
+}
+
+//---- recording ----
+
+void FrameCapture::start_recording(Format format, std::string const &prefix, uint32_t frames_per_second) {
+	stop_recording();
+
+	recording_format = format;
+	recording_prefix = prefix;
+	recording_fps = std::max< uint32_t >(1, frames_per_second);
+	recorded_frames = 0;
+	dropped_frames = 0;
+
+	if (format == Y4M) {
+		std::string filename = prefix + ".y4m";
+		y4m.open(filename, std::ios::binary);
+		if (!y4m) {
+			std::cerr << "Error opening '" << filename << "' for recording." << std::endl;
+			return;
+		}
+		y4m_next = 0;
+		y4m_repeats = 0;
+		y4m_last.clear();
+		std::cout << "Recording to '" << filename << "'." << std::endl;
+	} else {
+		std::cout << "Recording to '" << prefix << "_NNNNNN.png'." << std::endl;
+	}
+	is_recording = true;
+}
+
+void FrameCapture::stop_recording() {
+	if (!is_recording) return;
+	is_recording = false;
+
+	//finish every frame in flight (screenshots included, which is harmless):
+	while (true) {
+		poll();
+		bool busy = false;
+		for (auto &slot : slots) {
+			if (slot.state.load(std::memory_order_relaxed) != Slot::Free) busy = true;
+		}
+		if (!busy) break;
+		std::this_thread::yield();
+	}
+
+	if (recording_format == Y4M) {
+		std::lock_guard< std::mutex > lock(y4m_mutex);
+		write_y4m_frames(); //(repeats for frames dropped after the last one written)
+		y4m.close();
+	}
+	std::cout << "Recorded " << recorded_frames << " frames (" << dropped_frames << " dropped because the encoders fell behind)." << std::endl;
+}
+
+//---- collecting and encoding ----
+
+void FrameCapture::skip(Slot &slot) {
+	capture_dropped.add(1);
+	if (slot.format == Y4M) {
+		//(skip it in the stream, so later frames aren't left waiting for it)
+		slot.state.store(Slot::Encoding, std::memory_order_relaxed);
+		std::lock_guard< std::mutex > lock(y4m_mutex);
+		slot.yuv.clear();
+		slot.converted = true;
+		write_y4m_frames();
+	} else {
+		slot.state.store(Slot::Done, std::memory_order_relaxed);
+	}
+}
+
+void FrameCapture::poll() {
+	for (auto &slot : slots) {
+		Slot::State state = slot.state.load(std::memory_order_acquire);
+		if (state == Slot::Reading) {
+			//(flush on every check, so the fence is sure to reach the GPU)
+			GLenum result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+			if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) continue;
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+
+			TRACE_ZONE("capture map");
+			gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+			slot.pixels = reinterpret_cast< glm::u8vec4 * >(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.buffer_size, GL_MAP_READ_BIT | GL_MAP_WRITE_BIT));
+			gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+			if (!slot.pixels) {
+				std::cerr << "Error mapping a capture buffer; frame not saved." << std::endl;
+				skip(slot);
+				continue;
+			}
+
+			slot.state.store(Slot::Encoding, std::memory_order_relaxed);
+			Slot *s = &slot;
+			if (!jobs->run_background(jobs->create([s](){ encode(s); }))) {
+				//(background queue full; give up on this frame)
+				std::cerr << "Too much background work; frame not saved." << std::endl;
+				skip(slot);
+			}
+		} else if (state == Slot::Done) {
+			if (slot.pixels) { //(not mapped if mapping failed)
+				gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+				gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+				slot.pixels = nullptr;
+			}
+			slot.state.store(Slot::Free, std::memory_order_relaxed);
+		}
+	}
+	GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
+}
+
+//RGBA (lower-left origin) to planar YUV 4:2:0 (upper-left origin), full-range BT.601
+// (the stream header says so with XCOLORRANGE=FULL; C420jpeg only gives the chroma siting):
+static void rgba_to_i420(glm::u8vec4 const *pixels, glm::uvec2 size, std::vector< uint8_t > *yuv_) {
+	uint32_t w = size.x, h = size.y;
+	uint32_t cw = (w + 1) / 2, ch = (h + 1) / 2;
+	std::vector< uint8_t > &yuv = *yuv_;
+	yuv.resize(size_t(w) * h + 2 * size_t(cw) * ch);
+	uint8_t *Y = yuv.data();
+	uint8_t *U = Y + size_t(w) * h;
+	uint8_t *V = U + size_t(cw) * ch;
+
+	auto at = [&](uint32_t x, uint32_t y) -> glm::u8vec4 const & {
+		return pixels[size_t(h - 1 - y) * w + x]; //(flip to top-down)
+	};
+
+	for (uint32_t y = 0; y < h; ++y) {
+		for (uint32_t x = 0; x < w; ++x) {
+			glm::u8vec4 const &p = at(x, y);
+			Y[size_t(y) * w + x] = uint8_t((77 * p.r + 150 * p.g + 29 * p.b + 128) >> 8);
+		}
+	}
+	for (uint32_t cy = 0; cy < ch; ++cy) {
+		for (uint32_t cx = 0; cx < cw; ++cx) {
+			//average the 2x2 block (clamped at odd edges):
+			uint32_t x0 = 2 * cx, x1 = std::min(x0 + 1, w - 1);
+			uint32_t y0 = 2 * cy, y1 = std::min(y0 + 1, h - 1);
+			int32_t r = 0, g = 0, b = 0;
+			for (glm::u8vec4 const *p : { &at(x0, y0), &at(x1, y0), &at(x0, y1), &at(x1, y1) }) {
+				r += p->r; g += p->g; b += p->b;
+			}
+			//(saturated blue or red lands just past 255)
+			U[size_t(cy) * cw + cx] = uint8_t(std::min(255, ((-43 * r - 85 * g + 128 * b + 512) >> 10) + 128));
+			V[size_t(cy) * cw + cx] = uint8_t(std::min(255, ((128 * r - 107 * g - 21 * b + 512) >> 10) + 128));
+		}
+	}
+}
+
+void FrameCapture::encode(Slot *slot) {
+	if (slot->format == Y4M) {
+		{
+			TRACE_ZONE("capture convert");
+			rgba_to_i420(slot->pixels, slot->size, &slot->yuv);
+		}
+		FrameCapture *owner = slot->owner;
+		std::lock_guard< std::mutex > lock(owner->y4m_mutex);
+		slot->converted = true;
+		owner->write_y4m_frames();
+		return;
+	}
+
+	TRACE_ZONE("capture encode");
+	//the framebuffer's alpha isn't meaningful; make the image opaque:
+	glm::u8vec4 *pixels = slot->pixels;
+	for (size_t i = 0, count = size_t(slot->size.x) * slot->size.y; i < count; ++i) {
+		pixels[i].a = 0xff;
+	}
+	bool is_screenshot = (slot->sequence == ~uint64_t(0));
+	//(recordings trade file size for keeping up with the frame rate)
+	save_png(slot->filename, slot->size, pixels, LowerLeftOrigin, is_screenshot ? PNGDefault : PNGFastCapture);
+	if (is_screenshot) {
+		std::cout << "Saved screenshot to '" << slot->filename << "'." << std::endl;
+	}
+	slot->state.store(Slot::Done, std::memory_order_release);
+}
+
+void FrameCapture::write_y4m_frames() {
+	auto write_frame = [this](std::vector< uint8_t > const &yuv) {
+		if (yuv.empty()) return; //(nothing written yet to repeat)
+		y4m << "FRAME\n";
+		y4m.write(reinterpret_cast< char const * >(yuv.data()), yuv.size());
+	};
+
+	//frames dropped after the last frame written repeat it:
+	for (; y4m_repeats > 0; --y4m_repeats) {
+		write_frame(y4m_last);
+	}
+
+	//write every converted frame that is next in line (frames convert in parallel, so they may finish out of order):
+	bool wrote = true;
+	while (wrote) {
+		wrote = false;
+		for (auto &slot : slots) {
+			//(only converted Y4M slots have 'converted' set, and their other fields are stable then)
+			if (!slot.converted || slot.sequence != y4m_next) continue;
+			TRACE_ZONE("capture write");
+			//(a skipped frame has no 'yuv', and repeats the one before it instead)
+			if (!slot.yuv.empty()) y4m_last.swap(slot.yuv);
+			write_frame(y4m_last);
+			for (; slot.repeats > 0; --slot.repeats) {
+				write_frame(y4m_last);
+			}
+			slot.converted = false;
+			y4m_next += 1;
+			slot.state.store(Slot::Done, std::memory_order_release);
+			wrote = true;
+		}
+	}
+}
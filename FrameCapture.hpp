@@ -0,0 +1,119 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * FrameCapture saves rendered frames -- single screenshots, or every frame
+ *  while recording -- without stalling the render thread.
+ *
+ * Each capture queues a glReadPixels into one of a ring of MaxSlots pixel
+ *  buffer objects and drops a fence after it. poll() (once per frame) notices
+ *  when a fence has signalled -- usually a frame or two later -- maps the
+ *  buffer, and hands the mapped pixels to a background job on the JobSystem
+ *  workers, which fixes up alpha and encodes a PNG, or converts the frame to
+ *  YUV 4:2:0 for a Y4M stream. Once the job is done, a later poll() unmaps
+ *  the buffer for reuse.
+ *
+ * PNG frames are encoded in parallel (in any order, since each is its own
+ *  file); Y4M frames are converted in parallel and then written strictly in
+ *  order, by whichever job finds the next frame ready.
+ *
+ * When recording outpaces the encoders and every slot is busy, frames are
+ *  dropped (and counted), or -- with WaitForEncoders -- the render thread
+ *  waits for a slot, slowing the game to the encoders' pace. A Y4M stream
+ *  has a fixed frame rate, so it writes the previous frame again in place
+ *  of each dropped or skipped one to keep time.
+ */
+
+struct FrameCapture {
+	FrameCapture();
+	//finishes (and waits for) everything in flight:
+	~FrameCapture();
+	FrameCapture(FrameCapture const &) = delete;
+	FrameCapture &operator=(FrameCapture const &) = delete;
+
+	//read back the default framebuffer's back buffer (so: call after drawing, before swapping) as one PNG;
+	// returns 'false' (and skips it) if no slot is free, or if 'filename' is still being saved:
+	bool screenshot(glm::uvec2 const &size, std::string const &filename);
+
+	enum Format : uint8_t {
+		PNGSequence, //<prefix>_000000.png, <prefix>_000001.png, ...
+		Y4M, //<prefix>.y4m (raw YUV 4:2:0; plays in ffplay / mpv, converts with ffmpeg)
+	};
+	void start_recording(Format format, std::string const &prefix, uint32_t frames_per_second);
+	//waits for frames in flight, then closes the stream:
+	void stop_recording();
+	bool recording() const { return is_recording; }
+
+	enum Backpressure : uint8_t {
+		DropFrames,
+		WaitForEncoders,
+	};
+	Backpressure backpressure = DropFrames;
+
+	//while recording, capture this frame (same timing as screenshot()):
+	void frame_drawn(glm::uvec2 const &size);
+
+	//called by the main loop once per frame:
+	void poll();
+
+	enum : uint32_t { MaxSlots = 8 };
+
+private:
+	struct Slot {
+		enum State : uint8_t {
+			Free,
+			Reading, //readback queued on the GPU
+			Encoding, //mapped, background job running (or, for Y4M, converted and waiting its turn to be written)
+			Done, //job finished; unmap on the next poll()
+		};
+		std::atomic< State > state{Free};
+		GLuint buffer = 0;
+		GLsizeiptr buffer_size = 0;
+		GLsync fence = 0;
+		glm::uvec2 size = glm::uvec2(0);
+
+		Format format = PNGSequence; //(screenshots are PNGs too)
+		std::string filename; //PNGs
+		uint64_t sequence = 0; //Y4M: order in the stream
+		bool converted = false; //Y4M: 'yuv' is ready to write (guarded by y4m_mutex)
+		std::vector< uint8_t > yuv; //Y4M
+		uint32_t repeats = 0; //Y4M: frames dropped right after this one, written as copies of it (guarded by y4m_mutex)
+
+		glm::u8vec4 *pixels = nullptr; //mapped, while Encoding
+		FrameCapture *owner = nullptr;
+	};
+	Slot slots[MaxSlots];
+	uint32_t next_slot = 0; //(slots are used round-robin, so Y4M frames finish roughly in order)
+
+	//a free slot, or nullptr:
+	Slot *acquire_slot();
+	void read_back(Slot &slot, glm::uvec2 const &size);
+	static void encode(Slot *slot);
+	//give up on a slot's frame (keeping a Y4M stream's order):
+	void skip(Slot &slot);
+	void write_y4m_frames(); //(called with y4m_mutex held)
+
+	bool is_recording = false;
+	Format recording_format = PNGSequence;
+	std::string recording_prefix;
+	uint32_t recording_fps = 60;
+	glm::uvec2 recording_size = glm::uvec2(0); //(Y4M; fixed by the first frame)
+	uint64_t recorded_frames = 0;
+	uint64_t dropped_frames = 0;
+
+	std::mutex y4m_mutex;
+	std::ofstream y4m;
+	uint64_t y4m_next = 0; //sequence number of the next frame to write
+	uint64_t y4m_repeats = 0; //frames dropped after the last frame written, still to be written as copies of it
+	std::vector< uint8_t > y4m_last; //the last frame written (swapped out of its slot)
+};
@@ -0,0 +1,141 @@
+#include "FrameMetrics.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//index of the highest set bit ('v' must be nonzero):
+static inline uint32_t highest_bit(uint64_t v) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, v);
+	return uint32_t(index);
+#else
+	return 63 - uint32_t(__builtin_clzll(v));
+#endif
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+	uint32_t bucket;
+	if (ns < SubBuckets) {
+		bucket = uint32_t(ns);
+	} else {
+		//values in [2^e, 2^(e+1)) share 'shift' and are split into SubBuckets linear steps:
+		uint32_t shift = highest_bit(ns) - SubBucketBits;
+		bucket = (shift + 1) * SubBuckets + uint32_t(ns >> shift) - SubBuckets;
+	}
+	buckets[bucket] += 1;
+	count += 1;
+	if (ns > max) max = ns;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+	if (count == 0) return 0;
+	uint64_t target = uint64_t(p / 100.0 * count + 0.5);
+	if (target < 1) target = 1;
+	if (target > count) target = count;
+
+	uint64_t seen = 0;
+	for (uint32_t bucket = 0; bucket < Buckets; ++bucket) {
+		seen += buckets[bucket];
+		if (seen >= target) {
+			if (bucket < SubBuckets) return bucket;
+			uint32_t shift = bucket / SubBuckets - 1;
+			uint64_t sub = bucket % SubBuckets + SubBuckets;
+			uint64_t edge = ((sub + 1) << shift) - 1;
+			return (edge < max ? edge : max);
+		}
+	}
+	return max;
+}
+
+FrameMetrics::FrameMetrics(std::string const &path, uint32_t capacity) {
+	mapped_bytes = sizeof(Header) + size_t(capacity) * sizeof(FrameRecord);
+
+#ifndef _WIN32
+	//keep the last session's data (which may be from a crash) around for one more run:
+	std::rename(path.c_str(), (path + ".prev").c_str());
+
+	int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd >= 0 && ftruncate(fd, off_t(mapped_bytes)) == 0) {
+		void *memory = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (memory != MAP_FAILED) {
+			header = static_cast< Header * >(memory);
+			mapped = true;
+		}
+	}
+	if (fd >= 0) close(fd); //(the mapping keeps the file open)
+	if (!mapped) {
+		std::cerr << "NOTE: couldn't map '" << path << "' for frame metrics; keeping them in memory only." << std::endl;
+	}
+#endif
+
+	if (!mapped) {
+		header = static_cast< Header * >(::operator new(mapped_bytes));
+	}
+
+	std::memset(static_cast< void * >(header), 0, sizeof(Header));
+	std::memcpy(header->magic, "FRMETRIC", 8);
+	header->version = 1;
+	header->record_size = sizeof(FrameRecord);
+	header->capacity = capacity;
+	header->written = 0;
+	records = reinterpret_cast< FrameRecord * >(header + 1);
+}
+
+FrameMetrics::~FrameMetrics() {
+#ifndef _WIN32
+	if (mapped) {
+		munmap(static_cast< void * >(header), mapped_bytes);
+		return;
+	}
+#endif
+	::operator delete(static_cast< void * >(header));
+}
+
+void FrameMetrics::record(FrameRecord const &record) {
+	uint64_t index = header->written;
+	records[index % header->capacity] = record;
+	header->written = index + 1;
+
+	update.record(record.update_ns);
+	draw.record(record.draw_ns);
+	swap.record(record.swap_ns);
+	total.record(record.total_ns);
+	if (record.input_age_ns) input_age.record(record.input_age_ns);
+}
+
+void FrameMetrics::report(std::ostream &out) const {
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(2);
+
+	out << "Frame times over " << total.count << " frames (ms):\n";
+	auto line = [&out](char const *name, LatencyHistogram const &h) {
+		out << "  " << std::setw(9) << std::left << name << std::right
+		    << " p50 " << std::setw(7) << h.percentile(50.0) * 1.0e-6
+		    << "  p99 " << std::setw(7) << h.percentile(99.0) * 1.0e-6
+		    << "  p99.9 " << std::setw(7) << h.percentile(99.9) * 1.0e-6
+		    << "  max " << std::setw(7) << h.max * 1.0e-6
+		    << "  (" << h.count << " samples)\n";
+	};
+	line("update", update);
+	line("draw", draw);
+	line("swap", swap);
+	line("total", total);
+	line("input age", input_age);
+
+	out.flags(flags);
+	out.precision(precision);
+}
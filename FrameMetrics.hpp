@@ -0,0 +1,80 @@
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <stdint.h>
+
+/*
+ * LatencyHistogram counts nanosecond durations in log-linear buckets
+ *  (32 per power of two, so values are kept to within ~3%), like an HDR
+ *  histogram. Recording is a few integer ops; percentiles are read by
+ *  walking the buckets.
+ */
+
+struct LatencyHistogram {
+	void record(uint64_t ns);
+	//upper edge of the bucket holding the 'p'th percentile (p in [0,100]):
+	uint64_t percentile(double p) const;
+	uint64_t count = 0;
+	uint64_t max = 0;
+
+	enum : uint32_t {
+		SubBucketBits = 5,
+		SubBuckets = 1 << SubBucketBits,
+		Buckets = (64 - SubBucketBits + 1) * SubBuckets,
+	};
+	uint32_t buckets[Buckets] = { };
+};
+
+/*
+ * FrameMetrics records one FrameRecord per frame into a ring inside a
+ *  memory-mapped file, so the last 'capacity' frames survive a crash. The
+ *  file is a FrameMetrics::Header followed by the ring; 'written' counts
+ *  records ever written (the newest is at (written-1) % capacity).
+ * A file left by the previous session is kept as "<path>.prev".
+ *
+ * Durations also go into per-phase histograms for report().
+ * (On Windows the ring lives in ordinary memory.)
+ */
+
+struct FrameRecord {
+	uint64_t frame = 0; //frame number
+	uint64_t start_ns = 0; //frame start, since the session started
+	//(the durations below saturate at UINT32_MAX, about 4.29s)
+	uint32_t update_ns = 0;
+	uint32_t draw_ns = 0;
+	uint32_t swap_ns = 0;
+	uint32_t total_ns = 0;
+	uint32_t input_age_ns = 0; //oldest input handled this frame to end of swap (0 if none)
+	uint32_t reserved = 0;
+};
+static_assert(sizeof(FrameRecord) == 40, "FrameRecord is a file format; keep it packed");
+
+struct FrameMetrics {
+	FrameMetrics(std::string const &path, uint32_t capacity = 1 << 16);
+	~FrameMetrics();
+	FrameMetrics(FrameMetrics const &) = delete;
+	FrameMetrics &operator=(FrameMetrics const &) = delete;
+
+	void record(FrameRecord const &record);
+
+	//p50 / p99 / p99.9 / max of each phase:
+	void report(std::ostream &out) const;
+
+	struct Header {
+		char magic[8]; //"FRMETRIC"
+		uint32_t version; //1
+		uint32_t record_size; //sizeof(FrameRecord)
+		uint64_t capacity;
+		volatile uint64_t written;
+	};
+	static_assert(sizeof(Header) == 32, "FrameMetrics::Header is a file format; keep it packed");
+
+	LatencyHistogram update, draw, swap, total, input_age;
+
+private:
+	Header *header = nullptr;
+	FrameRecord *records = nullptr;
+	size_t mapped_bytes = 0;
+	bool mapped = false; //false if 'header' is heap memory
+};
@@ -0,0 +1,91 @@
+#include "FramePacer.hpp"
+
+#include "counters.hpp"
+#include "trace_zones.hpp"
+
+//for the GL_ERRORS() macro:
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+static Counter &pacer_wait_us = counters.add("pacer gpu wait us");
+static Counter &pacer_sleep_us = counters.add("pacer sleep us");
+
+FramePacer::FramePacer() {
+}
+
+FramePacer::~FramePacer() {
+	for (auto &fence : fences) {
+		if (fence) glDeleteSync(fence);
+	}
+}
+
+void FramePacer::set_mode(Mode mode_) {
+	mode = mode_;
+	frames_ahead = (mode == LowestLatency ? 0 : MaxFramesAhead);
+}
+
+void FramePacer::wait_before_input() {
+	TRACE_ZONE("pacer");
+
+	{ //wait for the GPU to finish frame (frame - 1 - frames_ahead):
+		uint32_t ahead = std::min< uint32_t >(frames_ahead, MaxFramesAhead);
+		if (frame >= ahead + 1) {
+			GLsync &fence = fences[(frame - 1 - ahead) % (MaxFramesAhead + 1)];
+			if (fence) {
+				auto before = Clock::now();
+				GLenum result;
+				do {
+					result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000); //100ms
+				} while (result == GL_TIMEOUT_EXPIRED);
+				pacer_wait_us.add(uint64_t(std::chrono::duration_cast< std::chrono::microseconds >(Clock::now() - before).count()));
+			}
+		}
+	}
+
+	if (mode == LowestLatency && have_last_swap) {
+		//start as late as possible while still finishing before the next vsync:
+		auto target = last_swap_end
+			+ std::chrono::microseconds(int64_t(vsync_period_us))
+			- std::chrono::microseconds(int64_t(work_us))
+			- margin;
+		auto now = Clock::now();
+		if (target > now) {
+			std::this_thread::sleep_until(target);
+			pacer_sleep_us.add(uint64_t(std::chrono::duration_cast< std::chrono::microseconds >(Clock::now() - now).count()));
+		}
+	}
+}
+
+void FramePacer::frame_swapped(Clock::time_point work_start, Clock::time_point swap_start) {
+	auto now = Clock::now();
+
+	//fence for this frame (replacing the one from MaxFramesAhead+1 frames ago):
+	GLsync &fence = fences[frame % (MaxFramesAhead + 1)];
+	if (fence) glDeleteSync(fence);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame += 1;
+
+	//frame work estimate: mean plus a few mean deviations, so occasional slow frames still make it:
+	float work = std::chrono::duration< float, std::micro >(swap_start - work_start).count();
+	if (work_mean_us == 0.0f) work_mean_us = work;
+	work_deviation_us = 0.9f * work_deviation_us + 0.1f * std::abs(work - work_mean_us);
+	work_mean_us = 0.9f * work_mean_us + 0.1f * work;
+	work_us = work_mean_us + 3.0f * work_deviation_us;
+
+	//vsync period estimate from swap-to-swap intervals (when swaps block, they return at vsync);
+	// the shortest recent interval ignores frames that missed a vsync:
+	if (have_last_swap) {
+		float interval = std::chrono::duration< float, std::micro >(now - last_swap_end).count();
+		intervals_us[interval_count % IntervalHistory] = std::max(2000.0f, std::min(100000.0f, interval));
+		interval_count += 1;
+		uint32_t count = std::min< uint32_t >(interval_count, IntervalHistory);
+		vsync_period_us = *std::min_element(intervals_us, intervals_us + count);
+	}
+	last_swap_end = now;
+	have_last_swap = true;
+
+	GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <chrono>
+#include <stdint.h>
+
+/*
+ * FramePacer limits how far the CPU may run ahead of the GPU, and (in
+ *  LowestLatency mode) delays input sampling so each frame starts as late as
+ *  it safely can.
+ *
+ * A fence goes in after every swap. Before frame N reads input, wait_before_input()
+ *  waits until the GPU has finished frame N-1-frames_ahead; so with
+ *  frames_ahead = 0 the CPU never starts a frame while the GPU still has
+ *  work queued.
+ *
+ * In LowestLatency mode it then sleeps until (predicted next vsync) minus
+ *  (predicted frame work + margin), with the vsync period and the frame work
+ *  both estimated from recent frames.
+ */
+
+struct FramePacer {
+	using Clock = std::chrono::steady_clock;
+
+	FramePacer();
+	~FramePacer();
+	FramePacer(FramePacer const &) = delete;
+	FramePacer &operator=(FramePacer const &) = delete;
+
+	enum Mode : uint8_t {
+		LowestLatency, //frames_ahead 0, late input sampling
+		MaxThroughput, //frames_ahead 2, no sleeping
+	};
+	//also resets frames_ahead to the mode's default:
+	void set_mode(Mode mode);
+	Mode mode = MaxThroughput;
+
+	enum : uint32_t { MaxFramesAhead = 2 };
+	uint32_t frames_ahead = MaxFramesAhead; //0, 1, or 2
+
+	//called by the main loop before polling events:
+	void wait_before_input();
+
+	//called right after SDL_GL_SwapWindow; 'work_start' is when wait_before_input() returned:
+	void frame_swapped(Clock::time_point work_start, Clock::time_point swap_start);
+
+	//extra time left between the predicted end of a frame's work and vsync:
+	std::chrono::microseconds margin = std::chrono::microseconds(1500);
+
+	//current estimates (microseconds):
+	float vsync_period_us = 1.0e6f / 60.0f;
+	float work_us = 0.0f; //input sampling to swap, plus a deviation allowance
+
+private:
+	GLsync fences[MaxFramesAhead + 1] = { };
+	uint32_t frame = 0; //frames swapped so far
+
+	Clock::time_point last_swap_end;
+	bool have_last_swap = false;
+	enum : uint32_t { IntervalHistory = 32 };
+	float intervals_us[IntervalHistory] = { };
+	uint32_t interval_count = 0;
+	float work_mean_us = 0.0f;
+	float work_deviation_us = 0.0f;
+};
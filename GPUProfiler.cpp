@@ -0,0 +1,216 @@
+#include "GPUProfiler.hpp"
+
+#include "BatchRenderer.hpp"
+#include "pixel_text.hpp"
+
+//for the GL_ERRORS() macro:
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+GPUProfiler *gpu_profiler = nullptr;
+
+GPUProfiler::GPUProfiler() {
+	for (auto &frame : frames) {
+		glGenQueries(MaxPasses, frame.queries);
+	}
+	last_log = std::chrono::high_resolution_clock::now();
+	GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
+}
+
+GPUProfiler::~GPUProfiler() {
+	if (in_pass) end_pass();
+
+	//whole-run summary:
+	if (stats_count) {
+		std::cout << "GPU pass times:\n";
+		log(std::cout);
+		std::cout.flush();
+	}
+
+	for (auto &frame : frames) {
+		glDeleteQueries(MaxPasses, frame.queries);
+	}
+}
+
+void GPUProfiler::begin_frame() {
+	assert(!in_pass && "GPU pass left open at end of frame");
+
+	//the oldest slot's queries were issued FramesInFlight-1 frames ago:
+	current = (current + 1) % FramesInFlight;
+	collect(frames[current]);
+
+	if (show_overlay) {
+		auto now = std::chrono::high_resolution_clock::now();
+		if (std::chrono::duration< float >(now - last_log).count() >= log_interval) {
+			last_log = now;
+			log(std::cout);
+		}
+	}
+}
+
+void GPUProfiler::collect(Frame &frame) {
+	for (uint32_t i = 0; i < frame.count; ++i) {
+		GLint available = 0;
+		glGetQueryObjectiv(frame.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			//don't wait for it; the query will just be re-used:
+			dropped += 1;
+			continue;
+		}
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &ns);
+
+		double ms = double(ns) * 1.0e-6;
+		PassStats &pass = stats_for(frame.names[i]);
+		pass.last_ms = ms;
+		pass.average_ms = (pass.samples == 0 ? ms : 0.9 * pass.average_ms + 0.1 * ms);
+		pass.total_ms += ms;
+		pass.samples += 1;
+	}
+	frame.count = 0;
+}
+
+GPUProfiler::PassStats &GPUProfiler::stats_for(char const *name) {
+	for (uint32_t i = 0; i < stats_count; ++i) {
+		if (stats[i].name == name || std::strcmp(stats[i].name, name) == 0) return stats[i];
+	}
+	//frames never hold more than MaxPasses names, but different frames might use different names,
+	// so the last slot is kept as an "other" bucket rather than mixing new names into a real pass:
+	if (stats_count + 1 < MaxPasses) {
+		stats[stats_count].name = name;
+		return stats[stats_count++];
+	}
+	if (stats_count + 1 == MaxPasses) {
+		stats[stats_count++].name = "other";
+	}
+	return stats[MaxPasses-1];
+}
+
+void GPUProfiler::begin_pass(char const *name) {
+	Frame &frame = frames[current];
+	if (in_pass || frame.count == MaxPasses) {
+		ignored += 1;
+		return;
+	}
+	in_pass = true;
+	frame.names[frame.count] = name;
+	glBeginQuery(GL_TIME_ELAPSED, frame.queries[frame.count]);
+}
+
+void GPUProfiler::end_pass() {
+	if (!in_pass) return;
+	in_pass = false;
+	glEndQuery(GL_TIME_ELAPSED);
+	frames[current].count += 1;
+}
+
+GPUProfiler::Scope::Scope(char const *name) : active(gpu_profiler != nullptr && !gpu_profiler->in_pass) {
+	if (active) gpu_profiler->begin_pass(name);
+	else if (gpu_profiler) gpu_profiler->ignored += 1;
+}
+
+GPUProfiler::Scope::~Scope() {
+	if (active && gpu_profiler) gpu_profiler->end_pass();
+}
+
+void GPUProfiler::draw_overlay(glm::uvec2 const &drawable_size) {
+	if (!show_overlay || !batch_renderer) return;
+
+	//layout, in drawable pixels from the upper left corner:
+	const float margin = 8.0f;
+	const float row_height = 10.0f;
+	const float row_gap = 4.0f;
+	const float budget_width = 240.0f; //bar length for one 60Hz frame
+	const float text_scale = 2.0f; //5-pixel glyphs fill the 10-pixel row
+	const double budget_ms = 1000.0 / 60.0;
+
+	//one color per pass, in order of first appearance:
+	static const glm::u8vec4 pass_colors[MaxPasses] = {
+		glm::u8vec4(0xf2, 0x6b, 0x3a, 0xff),
+		glm::u8vec4(0x4c, 0xb8, 0xe6, 0xff),
+		glm::u8vec4(0x8c, 0xd6, 0x4b, 0xff),
+		glm::u8vec4(0xe6, 0xc2, 0x3c, 0xff),
+		glm::u8vec4(0xb4, 0x6e, 0xe0, 0xff),
+		glm::u8vec4(0xe0, 0x5a, 0x9c, 0xff),
+		glm::u8vec4(0x4f, 0xd1, 0xb0, 0xff),
+		glm::u8vec4(0xc8, 0xc8, 0xc8, 0xff),
+	};
+
+	//maps drawable pixels (origin lower left) to clip space:
+	glm::mat4 pixel_to_clip(
+		glm::vec4(2.0f / drawable_size.x, 0.0f, 0.0f, 0.0f),
+		glm::vec4(0.0f, 2.0f / drawable_size.y, 0.0f, 0.0f),
+		glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
+		glm::vec4(-1.0f, -1.0f, 0.0f, 1.0f)
+	);
+
+	Scope pass("overlay");
+
+	batch_renderer->begin(pixel_to_clip, drawable_size);
+
+	float top = drawable_size.y - margin;
+	float panel_height = std::max(1u, stats_count) * (row_height + row_gap) + row_gap;
+
+	//pass names go in a column to the left of the bars:
+	float label_width = 0.0f;
+	for (uint32_t i = 0; i < stats_count; ++i) {
+		label_width = std::max(label_width, pixel_text_width(text_scale, stats[i].name));
+	}
+	float bars_left = margin + row_gap + label_width + row_gap;
+	float panel_width = (bars_left - margin) + 2.0f * budget_width + row_gap;
+
+	//backdrop and the one-frame budget mark:
+	batch_renderer->set_layer(0);
+	batch_renderer->quad(
+		glm::vec2(margin + 0.5f * panel_width, top - 0.5f * panel_height),
+		glm::vec2(0.5f * panel_width, 0.5f * panel_height),
+		glm::u8vec4(0x00, 0x00, 0x00, 0xa0)
+	);
+	batch_renderer->set_layer(1);
+	batch_renderer->quad(
+		glm::vec2(bars_left + budget_width, top - 0.5f * panel_height),
+		glm::vec2(0.5f, 0.5f * panel_height),
+		glm::u8vec4(0xff, 0xff, 0xff, 0x80)
+	);
+
+	//labeled bars (clamped to two frames' worth):
+	for (uint32_t i = 0; i < stats_count; ++i) {
+		float width = float(std::min(2.0, stats[i].average_ms / budget_ms)) * budget_width;
+		width = std::max(1.0f, width);
+		float y = top - row_gap - (row_height + row_gap) * i - 0.5f * row_height;
+		draw_pixel_text(glm::vec2(margin + row_gap, y + 0.5f * row_height), text_scale, stats[i].name, glm::u8vec4(0xf0, 0xf0, 0xf0, 0xff));
+		batch_renderer->quad(
+			glm::vec2(bars_left + 0.5f * width, y),
+			glm::vec2(0.5f * width, 0.5f * row_height),
+			pass_colors[i]
+		);
+	}
+
+	batch_renderer->flush();
+
+	GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
+}
+
+void GPUProfiler::log(std::ostream &out) const {
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(3);
+	for (uint32_t i = 0; i < stats_count; ++i) {
+		PassStats const &pass = stats[i];
+		out << "  gpu " << std::setw(10) << std::left << pass.name << std::right
+		    << " last " << pass.last_ms << " ms"
+		    << ", recent " << pass.average_ms << " ms"
+		    << ", overall " << (pass.samples ? pass.total_ms / pass.samples : 0.0) << " ms"
+		    << " (" << pass.samples << " samples)\n";
+	}
+	if (dropped || ignored) {
+		out << "  gpu (" << dropped << " results dropped, " << ignored << " passes ignored)\n";
+	}
+	out.flags(flags);
+	out.precision(precision);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <iosfwd>
+#include <stdint.h>
+
+/*
+ * GPUProfiler measures how long the GPU spends on each render pass with
+ *  GL_TIME_ELAPSED queries.
+ *
+ * Query results arrive a few frames late, so each frame's queries live in a
+ *  ring of FramesInFlight slots and are only read back when their slot comes
+ *  around again; reading never stalls the pipeline (results that still aren't
+ *  ready are dropped and counted).
+ *
+ * Passes are bracketed with begin_pass()/end_pass() (or a Scope) and may not
+ *  nest, since GL allows only one active GL_TIME_ELAPSED query.
+ */
+
+struct GPUProfiler {
+	GPUProfiler();
+	~GPUProfiler();
+	GPUProfiler(GPUProfiler const &) = delete;
+	GPUProfiler &operator=(GPUProfiler const &) = delete;
+
+	//called by the main loop once per frame, before anything is drawn:
+	void begin_frame();
+
+	//'name' must outlive the profiler (use string literals):
+	void begin_pass(char const *name);
+	void end_pass();
+
+	//brackets a pass on the global gpu_profiler (if there is one):
+	struct Scope {
+		Scope(char const *name);
+		~Scope();
+		Scope(Scope const &) = delete;
+		Scope &operator=(Scope const &) = delete;
+		bool active;
+	};
+
+	//draws one bar per pass (through batch_renderer), scaled so a full bar is a 60Hz frame:
+	void draw_overlay(glm::uvec2 const &drawable_size);
+	bool show_overlay = false;
+
+	//writes one line per pass, with recent and whole-run averages:
+	void log(std::ostream &out) const;
+	//while the overlay is shown, log to std::cout this often:
+	float log_interval = 1.0f; //seconds
+
+	enum : uint32_t {
+		FramesInFlight = 4,
+		MaxPasses = 8,
+	};
+
+	struct PassStats {
+		char const *name = nullptr;
+		double last_ms = 0.0; //most recent result
+		double average_ms = 0.0; //exponential moving average of recent results
+		double total_ms = 0.0; //sum of all results
+		uint32_t samples = 0;
+	};
+	PassStats stats[MaxPasses]; //the last slot becomes "other" once MaxPasses-1 names have been seen
+	uint32_t stats_count = 0;
+
+	uint32_t dropped = 0; //results that weren't ready when their slot was reused
+	uint32_t ignored = 0; //passes that nested or didn't fit in MaxPasses
+
+private:
+	struct Frame {
+		GLuint queries[MaxPasses];
+		char const *names[MaxPasses];
+		uint32_t count = 0; //passes issued in this frame
+	};
+	Frame frames[FramesInFlight];
+	uint32_t current = 0; //index into frames
+	bool in_pass = false;
+
+	void collect(Frame &frame);
+	PassStats &stats_for(char const *name);
+
+	std::chrono::high_resolution_clock::time_point last_log;
+};
+
+//The profiler for the (single) GL context; created by main() once the context exists:
+extern GPUProfiler *gpu_profiler;
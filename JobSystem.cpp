@@ -0,0 +1,398 @@
+#include "JobSystem.hpp"
+
+#include "counters.hpp"
+#include "trace_zones.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+
+JobSystem *jobs = nullptr;
+
+static Counter &jobs_run = counters.add("jobs run");
+static Counter &jobs_stolen = counters.add("jobs stolen");
+
+namespace {
+
+//Chase-Lev work-stealing deque (in the C11 formulation of Le et al., "Correct
+// and Efficient Work-Stealing for Weak Memory Models"); the owner pushes and
+// pops at the bottom, thieves take from the top:
+struct WorkDeque {
+	enum : uint32_t { Capacity = JobSystem::MaxJobsPerThread };
+
+	//owner only; returns 'false' if full:
+	bool push(JobSystem::Job *job) {
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_acquire);
+		if (b - t >= int64_t(Capacity)) return false;
+		items[b & (Capacity - 1)].store(job, std::memory_order_relaxed);
+		bottom.store(b + 1, std::memory_order_release);
+		return true;
+	}
+
+	//owner only:
+	JobSystem::Job *pop() {
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+		if (t > b) {
+			//empty:
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		JobSystem::Job *job = items[b & (Capacity - 1)].load(std::memory_order_relaxed);
+		if (t == b) {
+			//last one; race thieves for it:
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = nullptr;
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	//any thread; leaves a worker-only job where it is unless 'worker' is set:
+	JobSystem::Job *steal(bool worker) {
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b) return nullptr;
+		JobSystem::Job *job = items[t & (Capacity - 1)].load(std::memory_order_relaxed);
+		//(if 'job' is stale, the exchange below fails anyway)
+		if (!worker && job->worker_only.load(std::memory_order_relaxed)) return nullptr;
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+		return job;
+	}
+
+	std::atomic< int64_t > top{0};
+	char padding[64]; //(thieves write 'top', the owner writes 'bottom')
+	std::atomic< int64_t > bottom{0};
+	std::atomic< JobSystem::Job * > items[Capacity];
+};
+
+//which slot the calling thread uses, for the JobSystem it last used:
+thread_local JobSystem const *tls_system = nullptr;
+thread_local uint32_t tls_slot = 0;
+//the job running on this thread is worker-only (so jobs it creates are, too):
+thread_local bool tls_worker_only = false;
+
+} //namespace
+
+struct JobSystem::Slot {
+	WorkDeque deque;
+	Job jobs[MaxJobsPerThread];
+	uint32_t next_job = 0; //(owner only)
+	uint32_t random = 0; //for picking steal victims (owner only)
+};
+
+JobSystem::JobSystem(uint32_t max_workers) {
+	uint32_t hardware = std::thread::hardware_concurrency();
+	uint32_t count = std::min(max_workers, (hardware > 1 ? hardware - 1 : 0));
+
+	slot_capacity = count + 1 + ExtraThreads;
+	slots.reset(new Slot[slot_capacity]);
+	for (uint32_t i = 0; i < slot_capacity; ++i) {
+		slots[i].random = 0x9e3779b9u * (i + 1);
+	}
+
+	//the creating thread is slot 0, workers are 1 .. count:
+	slot_count = count + 1;
+	worker_count = count;
+	tls_system = this;
+	tls_slot = 0;
+
+	workers.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		workers.emplace_back(&JobSystem::worker_main, this, i + 1);
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard< std::mutex > lock(sleep_mutex);
+		quit = true;
+	}
+	wake_cv.notify_all();
+	for (auto &w : workers) {
+		w.join();
+	}
+	if (tls_system == this) tls_system = nullptr;
+}
+
+JobSystem::Slot &JobSystem::slot() {
+	if (tls_system != this) {
+		uint32_t index = slot_count.fetch_add(1);
+		if (index >= slot_capacity) {
+			throw std::runtime_error("JobSystem used from more than " + std::to_string(ExtraThreads) + " extra threads.");
+		}
+		tls_system = this;
+		tls_slot = index;
+	}
+	return slots[tls_slot];
+}
+
+JobSystem::Job *JobSystem::allocate(Job *parent) {
+	Slot &s = slot();
+	Job *job;
+	//skip jobs still in use from the last time around (e.g., long background jobs);
+	// if every one is, help until one finishes:
+	for (uint32_t tries = 0; ; ++tries) {
+		job = &s.jobs[s.next_job];
+		s.next_job = (s.next_job + 1) & (MaxJobsPerThread - 1);
+		if (job->unfinished.load(std::memory_order_acquire) == 0) break;
+		if (tries >= MaxJobsPerThread) {
+			Job *other = find(s);
+			if (other) execute(s, other);
+			else std::this_thread::yield();
+			tries = 0;
+		}
+	}
+
+	job->call = nullptr;
+	job->parent = parent;
+	job->unfinished.store(1, std::memory_order_relaxed);
+	job->prerequisites.store(1, std::memory_order_relaxed);
+	job->dependent_count = 0;
+	job->worker_only.store(tls_worker_only, std::memory_order_relaxed);
+	if (parent) parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+	return job;
+}
+
+void JobSystem::depend(Job *job, Job *prerequisite) {
+	assert(prerequisite->dependent_count < MaxDependents && "too many dependents for one job");
+	prerequisite->dependents[prerequisite->dependent_count++] = job;
+	job->prerequisites.fetch_add(1, std::memory_order_relaxed);
+}
+
+void JobSystem::run(Job *job) {
+	if (job->prerequisites.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		push(slot(), job);
+	}
+}
+
+bool JobSystem::run_background(Job *job) {
+	assert(job->prerequisites.load(std::memory_order_relaxed) == 1 && "background jobs can't have prerequisites");
+	job->worker_only.store(true, std::memory_order_relaxed);
+	if (workers.empty()) {
+		job->prerequisites.store(0, std::memory_order_relaxed);
+		execute(slot(), job);
+		return true;
+	}
+	{
+		std::lock_guard< std::mutex > lock(background_mutex);
+		if (background_count == MaxBackground) return false;
+		job->prerequisites.store(0, std::memory_order_relaxed);
+		background[(background_begin + background_count) % MaxBackground] = job;
+		background_count += 1;
+	}
+	queued.fetch_add(1, std::memory_order_seq_cst);
+	if (sleeping.load(std::memory_order_seq_cst) > 0) {
+		{ std::lock_guard< std::mutex > lock(sleep_mutex); }
+		wake_cv.notify_one();
+	}
+	return true;
+}
+
+JobSystem::Job *JobSystem::take_background() {
+	std::lock_guard< std::mutex > lock(background_mutex);
+	if (background_count == 0) return nullptr;
+	Job *job = background[background_begin];
+	background_begin = (background_begin + 1) % MaxBackground;
+	background_count -= 1;
+	queued.fetch_sub(1, std::memory_order_relaxed);
+	return job;
+}
+
+void JobSystem::push(Slot &s, Job *job) {
+	if (!s.deque.push(job)) {
+		//deque full (only possible with jobs released by dependencies); just run it here:
+		execute(s, job);
+		return;
+	}
+	queued.fetch_add(1, std::memory_order_seq_cst);
+	if (sleeping.load(std::memory_order_seq_cst) > 0) {
+		//(taking the lock means the sleeper is either waiting, and gets the notify, or will see 'queued')
+		{ std::lock_guard< std::mutex > lock(sleep_mutex); }
+		wake_cv.notify_one();
+	}
+}
+
+JobSystem::Job *JobSystem::find(Slot &s) {
+	if (Job *job = s.deque.pop()) {
+		queued.fetch_sub(1, std::memory_order_relaxed);
+		return job;
+	}
+	//steal, starting from a random victim:
+	uint32_t count = std::min(slot_count.load(std::memory_order_relaxed), slot_capacity);
+	s.random ^= s.random << 13;
+	s.random ^= s.random >> 17;
+	s.random ^= s.random << 5;
+	uint32_t start = s.random % count;
+	uint32_t index = uint32_t(&s - &slots[0]);
+	bool worker = (index >= 1 && index <= worker_count);
+	for (uint32_t i = 0; i < count; ++i) {
+		Slot &victim = slots[(start + i) % count];
+		if (&victim == &s) continue;
+		if (Job *job = victim.deque.steal(worker)) {
+			queued.fetch_sub(1, std::memory_order_relaxed);
+			jobs_stolen.add(1);
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+void JobSystem::execute(Slot &s, Job *job) {
+	bool outer_worker_only = tls_worker_only;
+	tls_worker_only = job->worker_only.load(std::memory_order_relaxed);
+	job->call(*job);
+	tls_worker_only = outer_worker_only;
+	jobs_run.add(1);
+	finish(s, job);
+}
+
+void JobSystem::finish(Slot &s, Job *job) {
+	//(once 'unfinished' hits zero, a waiting thread may reuse the job; read it first)
+	Job *parent = job->parent;
+	uint32_t dependent_count = job->dependent_count;
+	Job *dependents[MaxDependents];
+	std::copy(job->dependents, job->dependents + dependent_count, dependents);
+
+	if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+	for (uint32_t i = 0; i < dependent_count; ++i) {
+		if (dependents[i]->prerequisites.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			push(s, dependents[i]);
+		}
+	}
+	if (parent) finish(s, parent);
+}
+
+void JobSystem::wait(Job *job) {
+	Slot &s = slot();
+	while (job->unfinished.load(std::memory_order_acquire) != 0) {
+		Job *other = find(s);
+		if (other) execute(s, other);
+		else std::this_thread::yield();
+	}
+}
+
+void JobSystem::worker_main(uint32_t index) {
+	trace_thread_name("worker");
+	tls_system = this;
+	tls_slot = index;
+	Slot &s = slots[index];
+
+	uint32_t idle = 0;
+	while (!quit.load(std::memory_order_relaxed)) {
+		Job *job = find(s);
+		if (!job) job = take_background();
+		if (job) {
+			execute(s, job);
+			idle = 0;
+			continue;
+		}
+		//spin briefly (more work often follows soon), then sleep until something is queued:
+		if (++idle < 64) {
+			std::this_thread::yield();
+			continue;
+		}
+		std::unique_lock< std::mutex > lock(sleep_mutex);
+		sleeping.fetch_add(1, std::memory_order_seq_cst);
+		wake_cv.wait(lock, [this](){ return quit.load(std::memory_order_relaxed) || queued.load(std::memory_order_seq_cst) > 0; });
+		sleeping.fetch_sub(1, std::memory_order_relaxed);
+		idle = 0;
+	}
+}
+
+//---- benchmark ----
+
+void JobSystem::benchmark(std::ostream &out) {
+	using Clock = std::chrono::steady_clock;
+	auto ns_per = [](Clock::time_point begin, Clock::time_point end, uint64_t count) {
+		return std::chrono::duration< double, std::nano >(end - begin).count() / double(count);
+	};
+
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(1);
+	out << "Job system overhead (" << thread_count() << " threads):\n";
+
+	std::atomic< uint64_t > sink{0};
+
+	{ //one job at a time, created, run, and waited for:
+		const uint32_t Count = 100000;
+		auto begin = Clock::now();
+		for (uint32_t i = 0; i < Count; ++i) {
+			Job *job = create([&sink](){ sink.fetch_add(1, std::memory_order_relaxed); });
+			run(job);
+			wait(job);
+		}
+		auto end = Clock::now();
+		out << "  run + wait, one job:       " << std::setw(8) << ns_per(begin, end, Count) << " ns/job\n";
+	}
+
+	{ //many children of one root (create and scheduling throughput):
+		const uint32_t Rounds = 1000;
+		const uint32_t Children = 512;
+		auto begin = Clock::now();
+		for (uint32_t r = 0; r < Rounds; ++r) {
+			Job *root = create([](){ });
+			for (uint32_t c = 0; c < Children; ++c) {
+				run(create([&sink](){ sink.fetch_add(1, std::memory_order_relaxed); }, root));
+			}
+			run(root);
+			wait(root);
+		}
+		auto end = Clock::now();
+		out << "  fan-out, 512 children:     " << std::setw(8) << ns_per(begin, end, uint64_t(Rounds) * Children) << " ns/job\n";
+	}
+
+	{ //a chain of dependencies (each job waits for the previous one):
+		const uint32_t Rounds = 1000;
+		const uint32_t Length = 64;
+		auto begin = Clock::now();
+		for (uint32_t r = 0; r < Rounds; ++r) {
+			Job *root = create([](){ });
+			Job *previous = nullptr;
+			Job *first = nullptr;
+			for (uint32_t c = 0; c < Length; ++c) {
+				Job *job = create([&sink](){ sink.fetch_add(1, std::memory_order_relaxed); }, root);
+				if (previous) {
+					depend(job, previous);
+					run(job); //(held until 'previous' finishes)
+				} else {
+					first = job;
+				}
+				previous = job;
+			}
+			run(first);
+			run(root);
+			wait(root);
+		}
+		auto end = Clock::now();
+		out << "  dependency chain of 64:    " << std::setw(8) << ns_per(begin, end, uint64_t(Rounds) * Length) << " ns/job\n";
+	}
+
+	{ //parallel_for over trivial items, per item, versus a plain loop:
+		const uint32_t Count = 1 << 20;
+		std::vector< uint32_t > data(Count, 1);
+		auto begin = Clock::now();
+		for (uint32_t i = 0; i < Count; ++i) data[i] = data[i] * 3 + 1;
+		auto end = Clock::now();
+		out << "  plain loop:                " << std::setw(8) << ns_per(begin, end, Count) << " ns/item\n";
+
+		for (uint32_t grain : { 1u << 12, 1u << 14, 1u << 16 }) {
+			begin = Clock::now();
+			parallel_for(Count, [&data](uint32_t i){ data[i] = data[i] * 3 + 1; }, grain);
+			end = Clock::now();
+			out << "  parallel_for, grain " << std::setw(6) << std::left << grain << std::right << ":" << std::setw(8) << ns_per(begin, end, Count) << " ns/item\n";
+		}
+		sink.fetch_add(data[Count / 2], std::memory_order_relaxed);
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * JobSystem runs small jobs on a fixed set of worker threads with work
+ *  stealing: every thread that uses it gets its own deque, pushes and pops
+ *  its own jobs at one end (so recently created, cache-warm jobs run first),
+ *  and idle threads steal from the other end of someone else's.
+ *
+ *   JobSystem::Job *root = jobs->create([](){ });
+ *   for (...) jobs->run(jobs->create([&](){ ... }, root)); //children of root
+ *   jobs->run(root);
+ *   jobs->wait(root); //helps run jobs until root and all its children are done
+ *
+ * or, for the common case:
+ *
+ *   jobs->parallel_for(count, [&](uint32_t i){ ... });
+ *
+ * Jobs come from a per-thread ring of MaxJobsPerThread, so creating one
+ *  never allocates; when the ring wraps around, jobs that haven't finished
+ *  yet are skipped (and if none has, the thread helps run jobs until one does). Function objects are copied
+ *  into the job (at most JobDataSize bytes, trivially destructible -- capture
+ *  by reference or pointer).
+ *
+ * Dependencies: depend(job, prerequisite) holds 'job' back (even after
+ *  run(job)) until 'prerequisite' has finished. Declare them before running
+ *  the prerequisite.
+ *
+ * Long jobs (file encoding and the like) go through run_background()
+ *  instead: only worker threads run those, when they have nothing else to
+ *  do, so one never ends up inside a frame-critical wait() on the main thread.
+ *  Jobs a background job creates (e.g., save_png's parallel_for bands) are
+ *  worker-only too: threads that aren't workers never steal them.
+ *
+ * The thread that creates the JobSystem counts as one of its threads; other
+ *  threads (e.g., the simulation thread) may use it too, up to ExtraThreads.
+ */
+
+struct JobSystem {
+	//starts (hardware threads - 1) workers, but no more than max_workers:
+	JobSystem(uint32_t max_workers);
+	~JobSystem();
+	JobSystem(JobSystem const &) = delete;
+	JobSystem &operator=(JobSystem const &) = delete;
+
+	enum : uint32_t {
+		JobDataSize = 48,
+		MaxDependents = 4,
+		MaxJobsPerThread = 1024, //(power of two)
+		ExtraThreads = 4,
+	};
+
+	struct Job {
+		void (*call)(Job &job);
+		Job *parent; //not finished until this job is
+		std::atomic< int32_t > unfinished{0}; //this job, plus unfinished children
+		std::atomic< int32_t > prerequisites{0}; //unfinished prerequisites, plus one until run()
+		Job *dependents[MaxDependents];
+		uint32_t dependent_count;
+		std::atomic< bool > worker_only{false}; //background jobs and everything they create
+		alignas(16) unsigned char data[JobDataSize];
+	};
+
+	//a job that calls fn(); 'parent', if given, must not have finished yet:
+	template< typename Fn >
+	Job *create(Fn const &fn, Job *parent = nullptr) {
+		static_assert(sizeof(Fn) <= JobDataSize, "job function object is too big; capture by reference");
+		static_assert(alignof(Fn) <= 16, "job function object is over-aligned");
+		static_assert(std::is_trivially_destructible< Fn >::value, "job function objects are never destroyed");
+		Job *job = allocate(parent);
+		new (job->data) Fn(fn);
+		job->call = [](Job &j) {
+			(*reinterpret_cast< Fn * >(j.data))();
+		};
+		return job;
+	}
+
+	//'job' won't start until 'prerequisite' finishes (call before running either):
+	void depend(Job *job, Job *prerequisite);
+
+	//queue 'job' (it starts once its prerequisites have finished):
+	void run(Job *job);
+
+	//queue a long job (without prerequisites) for the workers only; returns 'false' if MaxBackground are already queued:
+	// (with no workers at all, runs it right away)
+	bool run_background(Job *job);
+
+	//run jobs until 'job' and its children are finished:
+	void wait(Job *job);
+
+	//call fn(i) for every i in [0, count), in any order and on any thread, in batches of at least 'grain':
+	template< typename Fn >
+	void parallel_for(uint32_t count, Fn const &fn, uint32_t grain = 1) {
+		//(no more jobs than a handful per thread; beyond that they only add overhead)
+		grain = std::max(grain, (count + MaxJobsPerFor - 1) / MaxJobsPerFor);
+		if (count <= grain || thread_count() == 1) {
+			for (uint32_t i = 0; i < count; ++i) fn(i);
+			return;
+		}
+		Fn const *f = &fn;
+		Job *root = create([](){ });
+		for (uint32_t begin = 0; begin < count; begin += grain) {
+			uint32_t end = std::min(count, begin + grain);
+			run(create([f, begin, end](){
+				for (uint32_t i = begin; i < end; ++i) (*f)(i);
+			}, root));
+		}
+		run(root);
+		wait(root);
+	}
+
+	//workers, plus the creating thread:
+	uint32_t thread_count() const { return uint32_t(workers.size()) + 1; }
+
+	//times job creation, scheduling, and parallel_for overhead, and prints the results:
+	void benchmark(std::ostream &out);
+
+	enum : uint32_t { MaxJobsPerFor = 256, MaxBackground = 64 };
+
+private:
+	struct Slot; //one thread's deque and job ring
+	Slot &slot(); //the calling thread's (registering it on first use)
+	Job *allocate(Job *parent);
+	void push(Slot &slot, Job *job);
+	Job *find(Slot &slot); //own deque first, then steal
+	void execute(Slot &slot, Job *job);
+	void finish(Slot &slot, Job *job);
+	void worker_main(uint32_t index);
+	Job *take_background();
+
+	std::unique_ptr< Slot[] > slots;
+	uint32_t slot_capacity = 0;
+	std::atomic< uint32_t > slot_count{0};
+
+	std::vector< std::thread > workers;
+	uint32_t worker_count = 0; //(workers use slots 1 .. worker_count; set before any start)
+
+	//queued by run_background(), taken by idle workers:
+	std::mutex background_mutex;
+	Job *background[MaxBackground];
+	uint32_t background_begin = 0;
+	uint32_t background_count = 0;
+
+	//sleeping workers wait for 'queued' to become nonzero:
+	std::atomic< int32_t > queued{0};
+	std::atomic< int32_t > sleeping{0};
+	std::mutex sleep_mutex;
+	std::condition_variable wake_cv;
+	std::atomic< bool > quit{false};
+};
+
+//The job system shared by everything (renderer, modes, frame capture); created by main():
+extern JobSystem *jobs;
@@ -0,0 +1,94 @@
+#include "LatencyProbe.hpp"
+
+//for the GL_ERRORS() macro:
+#include "gl_errors.hpp"
+
+#include <SDL.h>
+
+#include <iostream>
+#include <iomanip>
+
+static uint64_t ns_between(LatencyProbe::Clock::time_point a, LatencyProbe::Clock::time_point b) {
+	if (b < a) return 0;
+	return uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(b - a).count());
+}
+
+LatencyProbe::LatencyProbe() {
+}
+
+LatencyProbe::~LatencyProbe() {
+	for (uint32_t i = 0; i < pending_count; ++i) {
+		glDeleteSync(pending[(pending_begin + i) % MaxPending].fence);
+	}
+}
+
+void LatencyProbe::motion(uint32_t sdl_timestamp) {
+	if (!enabled || have_input) return;
+	auto now = Clock::now();
+	//SDL timestamps share a clock with SDL_GetTicks(), so convert through the event's age:
+	uint32_t age_ms = SDL_GetTicks() - sdl_timestamp;
+	input_time = now - std::chrono::milliseconds(age_ms);
+	handled_time = now;
+	have_input = true;
+}
+
+void LatencyProbe::frame_swapped(Clock::time_point update_start, Clock::time_point draw_start) {
+	if (have_input) {
+		auto now = Clock::now();
+		handled.record(ns_between(input_time, handled_time));
+		update.record(ns_between(input_time, update_start));
+		draw.record(ns_between(input_time, draw_start));
+		swap.record(ns_between(input_time, now));
+
+		if (pending_count == MaxPending) {
+			//the GPU is far behind; forget the oldest frame rather than block:
+			glDeleteSync(pending[pending_begin].fence);
+			pending_begin = (pending_begin + 1) % MaxPending;
+			pending_count -= 1;
+		}
+		Pending &p = pending[(pending_begin + pending_count) % MaxPending];
+		p.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		p.input_time = input_time;
+		pending_count += 1;
+		have_input = false;
+
+		GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
+	}
+	poll();
+}
+
+void LatencyProbe::poll() {
+	while (pending_count) {
+		Pending &p = pending[pending_begin];
+		//(flush on the first check, so the fence is sure to reach the GPU)
+		GLenum result = glClientWaitSync(p.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) break;
+		gpu_done.record(ns_between(p.input_time, Clock::now()));
+		glDeleteSync(p.fence);
+		pending_begin = (pending_begin + 1) % MaxPending;
+		pending_count -= 1;
+	}
+}
+
+void LatencyProbe::report(std::ostream &out) const {
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(2);
+
+	out << "Mouse motion latency over " << swap.count << " frames (ms, +/- 1):\n";
+	auto line = [&out](char const *name, LatencyHistogram const &h) {
+		out << "  input to " << std::setw(8) << std::left << name << std::right
+		    << " p50 " << std::setw(7) << h.percentile(50.0) * 1.0e-6
+		    << "  p99 " << std::setw(7) << h.percentile(99.0) * 1.0e-6
+		    << "  p99.9 " << std::setw(7) << h.percentile(99.9) * 1.0e-6
+		    << "  max " << std::setw(7) << h.max * 1.0e-6 << "\n";
+	};
+	line("handled", handled);
+	line("update", update);
+	line("draw", draw);
+	line("swap", swap);
+	line("gpu done", gpu_done);
+
+	out.flags(flags);
+	out.precision(precision);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "FrameMetrics.hpp"
+#include "GL.hpp"
+
+#include <chrono>
+#include <iosfwd>
+
+/*
+ * LatencyProbe measures how long mouse motion takes to reach the screen.
+ *
+ * For every frame that consumed SDL_MOUSEMOTION, the oldest motion's SDL
+ *  timestamp is followed through the frame's stages (handled, update, draw,
+ *  swap returned), and a fence placed right after the swap marks when the
+ *  GPU finished that frame. Fences are polled without blocking (at the start
+ *  of each frame and after each swap), so "gpu done" is an upper bound,
+ *  accurate to about the polling interval.
+ *
+ * SDL timestamps are milliseconds, so every stage is +/- 1ms.
+ */
+
+struct LatencyProbe {
+	using Clock = std::chrono::steady_clock;
+
+	LatencyProbe();
+	~LatencyProbe();
+	LatencyProbe(LatencyProbe const &) = delete;
+	LatencyProbe &operator=(LatencyProbe const &) = delete;
+
+	bool enabled = false;
+
+	//when the main loop pulls a motion event off the queue (the oldest per frame counts):
+	void motion(uint32_t sdl_timestamp);
+
+	//after SDL_GL_SwapWindow, with the frame's stage start times:
+	void frame_swapped(Clock::time_point update_start, Clock::time_point draw_start);
+
+	//check pending fences (called once per frame; frame_swapped also polls):
+	void poll();
+
+	//latency distributions from input to each stage:
+	void report(std::ostream &out) const;
+
+	LatencyHistogram handled, update, draw, swap, gpu_done;
+
+	enum : uint32_t { MaxPending = 8 };
+
+private:
+	bool have_input = false;
+	Clock::time_point input_time; //the SDL timestamp, converted to Clock
+	Clock::time_point handled_time;
+
+	struct Pending {
+		GLsync fence;
+		Clock::time_point input_time;
+	};
+	Pending pending[MaxPending];
+	uint32_t pending_begin = 0; //index of oldest
+	uint32_t pending_count = 0;
+};
@@ -0,0 +1,59 @@
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+MappedFile::MappedFile(std::string const &filename) {
+#ifndef _WIN32
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Failed to open '" + filename + "'.");
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to stat '" + filename + "'.");
+	}
+	size = size_t(info.st_size);
+	if (size > 0) { //(mmap won't map an empty file)
+		void *memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (memory == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("Failed to map '" + filename + "'.");
+		}
+		madvise(memory, size, MADV_SEQUENTIAL);
+		data = static_cast< uint8_t const * >(memory);
+		mapped = true;
+	}
+	close(fd); //(the mapping keeps the file open)
+#else
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open '" + filename + "'.");
+	}
+	file.seekg(0, std::ios::end);
+	copy.resize(size_t(file.tellg()));
+	file.seekg(0, std::ios::beg);
+	if (!file.read(reinterpret_cast< char * >(copy.data()), copy.size())) {
+		throw std::runtime_error("Failed to read '" + filename + "'.");
+	}
+	data = copy.data();
+	size = copy.size();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+	if (mapped) {
+		munmap(const_cast< uint8_t * >(data), size);
+	}
+#endif
+}
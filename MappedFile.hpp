@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * MappedFile maps a whole file read-only into memory, so it can be parsed in
+ *  place with no copies through a stream. Pages are read in by the OS as
+ *  they are first touched (hinted as sequential).
+ * (On Windows the file is read into ordinary memory instead.)
+ */
+
+struct MappedFile {
+	//throws on error:
+	MappedFile(std::string const &filename);
+	~MappedFile();
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	uint8_t const *data = nullptr;
+	size_t size = 0;
+
+private:
+	bool mapped = false;
+	std::vector< uint8_t > copy; //(when not mapped)
+};
@@ -3,6 +3,8 @@
 #include <SDL.h>
 #include <glm/glm.hpp>
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 
 struct Mode : std::enable_shared_from_this< Mode > {
@@ -13,6 +15,11 @@ struct Mode : std::enable_shared_from_this< Mode > {
 	//The function should return 'true' if it handled the event.
 	virtual bool handle_event(SDL_Event const &, glm::uvec2 const &window_size) { return false; }
 
+	//runs of SDL_MOUSEMOTION events already queued are merged into one before handle_event sees them
+	// (latest position and state, summed xrel/yrel; for modes on a simulation thread, only runs that share
+	//  a timestamp, so each input can still be applied at its own time); return 'true' here to get every motion event instead:
+	virtual bool wants_every_motion_event() const { return false; }
+
 	//update is called at the start of a new frame, after events are handled:
 	// 'elapsed' is time in seconds since the last call to 'update'
 	virtual void update(float elapsed) { }
@@ -20,6 +27,24 @@ struct Mode : std::enable_shared_from_this< Mode > {
 	//draw is called after update:
 	virtual void draw(glm::uvec2 const &drawable_size) = 0;
 
+	//scene_unchanged should return 'true' when drawing again would produce the same image as last time
+	// (e.g., a paused or finished game); the main loop then stops redrawing and runs at a reduced rate:
+	virtual bool scene_unchanged() const { return false; }
+
+	//modes that return a nonzero rate (ticks per second) have handle_event and update called
+	// on a separate simulation thread at that fixed rate, rather than once per frame (see SimThread.hpp):
+	virtual float simulation_rate() const { return 0.0f; }
+
+	//set by the simulation thread just before each update(): the point in time that update simulates up to, and
+	// whether that point ends a tick (rather than splitting one at an input); lets a mode stamp what it publishes
+	// with simulated rather than wall-clock time:
+	std::chrono::steady_clock::time_point simulated_time;
+	bool simulated_tick_end = true;
+
+	//set by a mode that is done (e.g., game over); the main loop then quits:
+	// (unlike set_current, safe to use from the simulation thread)
+	std::atomic< bool > finished{false};
+
 	//Mode::current is the Mode to which events are dispatched.
 	// use 'set_current' to change the current Mode (e.g., to switch to a menu)
 	static std::shared_ptr< Mode > current;
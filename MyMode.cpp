@@ -3,18 +3,46 @@
 //for the GL_ERRORS() macro:
 #include "gl_errors.hpp"
 
-//for glm::value_ptr() :
-#include <glm/gtc/type_ptr.hpp>
+//for the shared renderer:
+#include "BatchRenderer.hpp"
 
+//for per-pass GPU timings:
+#include "GPUProfiler.hpp"
+
+//for CPU timing zones:
+#include "trace_zones.hpp"
+
+//for the debug HUD:
+#include "counters.hpp"
+
+//for hardware performance counters:
+#include "perf_counters.hpp"
+
+//for allocation budgets:
+#include "alloc_tracking.hpp"
+
+//for unaccelerated mouse motion:
+#include "RawMouse.hpp"
+
+//for the simulation's input delay:
+#include "SimThread.hpp"
+
+#include <algorithm>
 #include <random>
 #include <math.h>
 #include <stdio.h>
 
-#define DEG2RAD(X)  ((X) * 3.14159f / 180)
-#define RAD2DEG(X)  ((X) * 180 / 3.14159f)
+#define PI 3.14159f
+#define DEG2RAD(X)  ((X) * PI / 180)
+#define RAD2DEG(X)  ((X) * 180 / PI)
 
 #define HEX_TO_U8VEC4( HX ) (glm::u8vec4( (HX >> 24) & 0xff, (HX >> 16) & 0xff, (HX >> 8) & 0xff, (HX) & 0xff ))
 
+static Counter &collision_tests = counters.add("collision tests");
+static Counter &bricks_live = counters.add("bricks live", Counter::Gauge);
+
+static PerfZoneStats collision_perf("collisions");
+
 MyMode::MyMode() {
 
 	// Ensure all the bricks are present
@@ -22,108 +50,21 @@ MyMode::MyMode() {
 		for (int brick = 0; brick < BRICKS_PER_ROW; brick++) {
 			//bricks[ring][brick] = (brick) % (ring + 2)!= 0;
 			bricks[ring][brick] = true;
+			hit_side[ring][brick] = INNER;
+			hit_lerp[ring][brick] = 0.0f;
 		}
 	}
 
-	//----- allocate OpenGL resources -----
-	{ //vertex buffer:
-		glGenBuffers(1, &vertex_buffer);
-		//for now, buffer will be un-filled.
-
-		GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
-	}
-
-	{ //vertex array mapping buffer for color_texture_program:
-		//ask OpenGL to fill vertex_buffer_for_color_texture_program with the name of an unused vertex array object:
-		glGenVertexArrays(1, &vertex_buffer_for_color_texture_program);
-
-		//set vertex_buffer_for_color_texture_program as the current vertex array object:
-		glBindVertexArray(vertex_buffer_for_color_texture_program);
-
-		//set vertex_buffer as the source of glVertexAttribPointer() commands:
-		glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-
-		//set up the vertex array object to describe arrays of MyMode::Vertex:
-		glVertexAttribPointer(
-			color_texture_program.Position_vec4, //attribute
-			3, //size
-			GL_FLOAT, //type
-			GL_FALSE, //normalized
-			sizeof(Vertex), //stride
-			(GLbyte *)0 + 0 //offset
-		);
-		glEnableVertexAttribArray(color_texture_program.Position_vec4);
-		//[Note that it is okay to bind a vec3 input to a vec4 attribute -- the w component will be filled with 1.0 automatically]
-
-		glVertexAttribPointer(
-			color_texture_program.Color_vec4, //attribute
-			4, //size
-			GL_UNSIGNED_BYTE, //type
-			GL_TRUE, //normalized
-			sizeof(Vertex), //stride
-			(GLbyte *)0 + 4*3 //offset
-		);
-		glEnableVertexAttribArray(color_texture_program.Color_vec4);
-
-		glVertexAttribPointer(
-			color_texture_program.TexCoord_vec2, //attribute
-			2, //size
-			GL_FLOAT, //type
-			GL_FALSE, //normalized
-			sizeof(Vertex), //stride
-			(GLbyte *)0 + 4*3 + 4*1 //offset
-		);
-		glEnableVertexAttribArray(color_texture_program.TexCoord_vec2);
-
-		//done referring to vertex_buffer, so unbind it:
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		//done setting up vertex array object, so unbind it:
-		glBindVertexArray(0);
-
-		GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
-	}
-
-	{ //solid white texture:
-		//ask OpenGL to fill white_tex with the name of an unused texture object:
-		glGenTextures(1, &white_tex);
-
-		//bind that texture object as a GL_TEXTURE_2D-type texture:
-		glBindTexture(GL_TEXTURE_2D, white_tex);
-
-		//upload a 1x1 image of solid white to the texture:
-		glm::uvec2 size = glm::uvec2(1,1);
-		std::vector< glm::u8vec4 > data(size.x*size.y, glm::u8vec4(0xff, 0xff, 0xff, 0xff));
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
-
-		//set filtering and wrapping parameters:
-		//(it's a bit silly to mipmap a 1x1 texture, but I'm doing it because you may want to use this code to load different sizes of texture)
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-		//since texture uses a mipmap and we haven't uploaded one, instruct opengl to make one for us:
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		//Okay, texture uploaded, can unbind it:
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
-	}
+	//so draw has something to show before the first tick:
+	tick_pose.time = simulated_time;
+	tick_pose.ball_cnt = ball_cnt;
+	tick_pose.sec_angle = sec_angle;
+	tick_pose.ball = ball;
+	publish_snapshot();
+	snapshots.acquire();
 }
 
 MyMode::~MyMode() {
-
-	//----- free OpenGL resources -----
-	glDeleteBuffers(1, &vertex_buffer);
-	vertex_buffer = 0;
-
-	glDeleteVertexArrays(1, &vertex_buffer_for_color_texture_program);
-	vertex_buffer_for_color_texture_program = 0;
-
-	glDeleteTextures(1, &white_tex);
-	white_tex = 0;
 }
 
 // Computes the intersection of a ray {origin, dir} with a circle centered about
@@ -178,32 +119,56 @@ glm::vec2 reflect(glm::vec2 dir, glm::vec2 normal) {
 	return dir - (normal * 2.0f * (dir.x * normal.x + dir.y * normal.y));
 }
 
-bool MyMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
-	float past_mouse_angle = mouse_angle;
+bool MyMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size_) {
+	window_size = window_size_;
 
-	if (evt.type == SDL_MOUSEMOTION) {
+	//(while raw motion is on, update follows that instead)
+	if (evt.type == SDL_MOUSEMOTION && !(raw_mouse && raw_mouse->source != RawMouse::None)) {
 		//convert mouse from window pixels (top-left origin, +y is down) to clip space ([-1,1]x[-1,1], +y is up):
-		glm::vec2 clip_mouse = glm::vec2(
+		mouse_to(glm::vec2(
 			(evt.motion.x + 0.5f) / window_size.x * 2.0f - 1.0f,
 			(evt.motion.y + 0.5f) / window_size.y *-2.0f + 1.0f
-		);
+		));
+	}
 
-		mouse_angle = RAD2DEG(atan2f(clip_mouse.y, clip_mouse.x));
-		
-		// Compute the difference in angle between frames
-		float delta_angle = mouse_angle - past_mouse_angle;
+	return false;
+}
 
-		// Normalize this difference to -180 to 180, and add it to our total angle
-		if (delta_angle >  180) delta_angle -= 360;
-		if (delta_angle < -180) delta_angle += 360;
+void MyMode::mouse_to(glm::vec2 clip_mouse_) {
+	float past_mouse_angle = mouse_angle;
+	clip_mouse = clip_mouse_;
 
-		sec_angle += delta_angle;
-	}
+	mouse_angle = RAD2DEG(atan2f(clip_mouse.y, clip_mouse.x));
+	
+	// Compute the difference in angle between frames
+	float delta_angle = mouse_angle - past_mouse_angle;
 
-	return false;
+	// Normalize this difference to -180 to 180, and add it to our total angle
+	if (delta_angle >  180) delta_angle -= 360;
+	if (delta_angle < -180) delta_angle += 360;
+
+	sec_angle += delta_angle;
 }
 
 void MyMode::update(float elapsed) {
+	TRACE_ZONE("MyMode::update");
+	ALLOC_BUDGET("MyMode::update", 0); //the simulation is fixed-size; it should never allocate
+
+	//pick up raw mouse motion as late as possible, right before the ring angle is used:
+	if (raw_mouse && raw_mouse->source != RawMouse::None && window_size.x && window_size.y) {
+		glm::ivec2 motion = raw_mouse->take();
+		if (motion.x || motion.y) {
+			glm::vec2 moved = clip_mouse + glm::vec2(
+				motion.x * 2.0f / window_size.x,
+				motion.y *-2.0f / window_size.y
+			);
+			mouse_to(glm::vec2(
+				std::max(-1.0f, std::min(1.0f, moved.x)),
+				std::max(-1.0f, std::min(1.0f, moved.y))
+			));
+		}
+	}
+
 	// Update the ring animations
 	for (int ring = 0; ring < RINGS; ring++) {
 		for (int brick = 0; brick < BRICKS_PER_ROW; brick++) {
@@ -220,18 +185,23 @@ void MyMode::update(float elapsed) {
 	
 	
 	bool hit = false;
+	uint64_t tests = 0; //ray intersections computed, for the debug HUD
+	PerfZone perf(collision_perf);
 	//Check collisions
 	for (int ring = 0; ring < RINGS; ring++) {
+		TRACE_ZONE("ring collisions");
 		float radius = INNER_RADIUS + ring;
 		float angle = sec_angle * INNER_RADIUS / radius;
 
 		float t = intersect_ring(ball, ball_velocity * elapsed, radius - ball_radius);
 		bool hit_inner = true;
+		tests += 1;
 
 		// If we don't hit the inside, try the outside
 		if (t < 0 || t > 1) {
 			t = intersect_ring(ball, ball_velocity * elapsed, (radius + RING_WIDTH) + ball_radius);
 			hit_inner = false;
+			tests += 1;
 		}
 
 		// If we intersect with a ring
@@ -270,7 +240,7 @@ void MyMode::update(float elapsed) {
 			glm::vec2 line (cosf(brick_angle), sinf(brick_angle));
 			
 			t = intersect_line_segment(line, radius - ball_radius, radius + RING_WIDTH + ball_radius, ball, ball_velocity * elapsed);
-			
+			tests += 1;
 			
 			int brick = i;
 			bool side = cross(ball, line) < 0;
@@ -295,7 +265,7 @@ void MyMode::update(float elapsed) {
 	// Test collision with the inner circle
 	if (!hit) {
 		float t = intersect_ring(ball, ball_velocity * elapsed, 1 + ball_radius);
-		
+		tests += 1;
 		if (t > 0 && t < 1) {
 			glm::vec2 hit_pos = ball + (ball_velocity * elapsed * t);
 			float norm = sqrtf(hit_pos.x * hit_pos.x + hit_pos.y * hit_pos.y);
@@ -307,6 +277,9 @@ void MyMode::update(float elapsed) {
 		}
 	}
 	
+	collision_tests.add(tests);
+	perf.stop();
+
 	// Update the ball position unless we've already handled the collision
 	if(!hit)
 	{
@@ -332,28 +305,74 @@ void MyMode::update(float elapsed) {
 
 		if (ball_cnt <= 0) {
 			printf("You lose!");
-			Mode::set_current(nullptr);
+			finished = true;
 		}
 	}
 
 	// Check if all bricks have been broken
 	bool done = true;
+	uint64_t live = 0;
 
 	for (int ring = 0; ring < RINGS; ring++) {
 		for (int brick = 0; brick < BRICKS_PER_ROW; brick++) {
 			if (bricks[ring][brick]) {
 				done = false;
+				live += 1;
 			}
 		}
 	}
 
+	bricks_live.set(live);
+
 	if (done) {
 		printf("You win!");
-		Mode::set_current(nullptr);
+		finished = true;
 	}
+
+	publish_snapshot();
+}
+
+void MyMode::publish_snapshot() {
+	Pose pose;
+	pose.time = simulated_time;
+	pose.ball_cnt = ball_cnt;
+	pose.sec_angle = sec_angle;
+	pose.ball = ball;
+
+	Snapshot &snapshot = snapshots.write();
+	snapshot.previous = tick_pose;
+	snapshot.latest = pose;
+	if (simulated_tick_end) tick_pose = pose;
+	std::copy(&bricks[0][0], &bricks[0][0] + RINGS * BRICKS_PER_ROW, &snapshot.bricks[0][0]);
+	std::copy(&hit_side[0][0], &hit_side[0][0] + RINGS * BRICKS_PER_ROW, &snapshot.hit_side[0][0]);
+	std::copy(&hit_lerp[0][0], &hit_lerp[0][0] + RINGS * BRICKS_PER_ROW, &snapshot.hit_lerp[0][0]);
+	snapshots.publish();
 }
 
 void MyMode::draw(glm::uvec2 const &drawable_size) {
+	TRACE_ZONE("MyMode::draw");
+
+	//------ pick the state to draw ------
+
+	//(the simulation runs on another thread, so draw only from its snapshots)
+	snapshots.acquire();
+	Snapshot const &state = snapshots.read();
+
+	//simulated time trails the wall clock by the input delay, and the newest tick may be up to
+	// a tick older than that; so draw one tick further back, between the snapshot's two poses:
+	float alpha = 1.0f;
+	{
+		auto render_time = std::chrono::steady_clock::now() - SimThread::InputDelay - std::chrono::duration< float >(1.0f / SIM_RATE);
+		float span = std::chrono::duration< float >(state.latest.time - state.previous.time).count();
+		if (span > 0.0f) {
+			alpha = std::chrono::duration< float >(render_time - state.previous.time).count() / span;
+			alpha = std::max(0.0f, std::min(1.0f, alpha));
+		}
+	}
+	float drawn_angle = glm::mix(state.previous.sec_angle, state.latest.sec_angle, alpha);
+	//(a lost ball teleports back to the start, so don't slide it there)
+	glm::vec2 drawn_ball = (state.previous.ball_cnt == state.latest.ball_cnt ? glm::mix(state.previous.ball, state.latest.ball, alpha) : state.latest.ball);
+
 	//some nice colors from the course web page:
 	const glm::u8vec4 bg_color = HEX_TO_U8VEC4(0x193b59ff);
 	const glm::u8vec4 fg_color = HEX_TO_U8VEC4(0xffffffff);
@@ -362,66 +381,64 @@ void MyMode::draw(glm::uvec2 const &drawable_size) {
 	const float wall_radius = 0.05f;
 	const float padding = 0.14f; //padding between outside of walls and edge of window
 
-	//---- compute vertices to draw ----
+	//------ compute court-to-window transform ------
 
-	//vertices will be accumulated into this list and then uploaded+drawn at the end of this function:
-	std::vector< Vertex > vertices;
+	//compute area that should be visible:
+	glm::vec2 scene_min = glm::vec2(
+		-court_radius.x - 2.0f * wall_radius - padding,
+		-court_radius.y - 2.0f * wall_radius - padding
+	);
+	glm::vec2 scene_max = glm::vec2(
+		court_radius.x + 2.0f * wall_radius + padding,
+		court_radius.y + 2.0f * wall_radius + padding
+	);
 
-	//inline helper functions for sector and circle drawing:
-	auto draw_sector = [&vertices](glm::vec2 center, glm::vec2 radius, glm::vec2 angles, glm::u8vec4 const& color) {
-		// Draw a sector as a series of 1-degree trapezoids
-		
-		float step = 1;
-
-		for (float angle = angles.x; angle < angles.y + .01f; angle += step) {
-			float rad0 = DEG2RAD(angle);
-			float rad1 = DEG2RAD(angle + step);
-			glm::vec2 inner_point0 = glm::vec2(cosf(rad0), sinf(rad0)) * radius.x + center;
-			glm::vec2 outer_point0 = glm::vec2(cosf(rad0), sinf(rad0)) * radius.y + center;
-			glm::vec2 inner_point1 = glm::vec2(cosf(rad1), sinf(rad1)) * radius.x + center;
-			glm::vec2 outer_point1 = glm::vec2(cosf(rad1), sinf(rad1)) * radius.y + center;
-			
-			vertices.emplace_back(glm::vec3(inner_point1.x, inner_point1.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
-			vertices.emplace_back(glm::vec3(inner_point0.x, inner_point0.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
-			vertices.emplace_back(glm::vec3(outer_point0.x, outer_point0.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
+	//compute window aspect ratio:
+	float aspect = drawable_size.x / float(drawable_size.y);
+	//we'll scale the x coordinate by 1.0 / aspect to make sure things stay square.
 
-			vertices.emplace_back(glm::vec3(outer_point0.x, outer_point0.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
-			vertices.emplace_back(glm::vec3(outer_point1.x, outer_point1.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
-			vertices.emplace_back(glm::vec3(inner_point1.x, inner_point1.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
-		}
-	};
+	//compute scale factor for court given that...
+	float scale = std::min(
+		(2.0f * aspect) / (scene_max.x - scene_min.x), //... x must fit in [-aspect,aspect] ...
+		(2.0f) / (scene_max.y - scene_min.y) //... y must fit in [-1,1].
+	);
 
-	auto draw_circle = [&vertices](glm::vec2 center, float radius, glm::u8vec4 const& color) {
-		//draw a circle as a series of triangles
+	glm::vec2 center = 0.5f * (scene_max + scene_min);
 
-		float step = 5;
+	//build matrix that scales and translates appropriately:
+	glm::mat4 court_to_clip = glm::mat4(
+		glm::vec4(scale / aspect, 0.0f, 0.0f, 0.0f),
+		glm::vec4(0.0f, scale, 0.0f, 0.0f),
+		glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
+		glm::vec4(-center.x * (scale / aspect), -center.y * scale, 0.0f, 1.0f)
+	);
+	//NOTE: glm matrices are specified in *Column-Major* order,
+	// so each line above is specifying a *column* of the matrix(!)
 
-		for (float angle = 0; angle < 360; angle += step) {
-			float rad0 = DEG2RAD(angle);
-			float rad1 = DEG2RAD(angle + step);
-			glm::vec2 outer_point0 = glm::vec2(cosf(rad0), sinf(rad0)) * radius + center;
-			glm::vec2 outer_point1 = glm::vec2(cosf(rad1), sinf(rad1)) * radius + center;
+	//also build the matrix that takes clip coordinates to court coordinates (used for mouse handling):
+	clip_to_court = glm::mat3x2(
+		glm::vec2(aspect / scale, 0.0f),
+		glm::vec2(0.0f, 1.0f / scale),
+		glm::vec2(center.x, center.y)
+	);
 
-			vertices.emplace_back(glm::vec3(center.x, center.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
-			vertices.emplace_back(glm::vec3(outer_point0.x, outer_point0.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
-			vertices.emplace_back(glm::vec3(outer_point1.x, outer_point1.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
-		}
-	};
-	
+	//---- record shapes to draw ----
+
+	batch_renderer->begin(court_to_clip, drawable_size);
 
 	//ball:
-	draw_circle(ball, ball_radius, fg_color);
+	batch_renderer->circle(drawn_ball, ball_radius, fg_color);
 
 	// Draw rings
 	glm::vec2 sec_center = glm::vec2(0, 0);
 	for (int ring = 0; ring < RINGS; ring++) {
 		// Compute the radius and angle offset for this ring
 		float radius = INNER_RADIUS + ring;
-		float ring_angle = sec_angle * INNER_RADIUS / radius;
+		float ring_angle = drawn_angle * INNER_RADIUS / radius;
 
 		for (int brick = 0; brick < BRICKS_PER_ROW; brick++) {
 			// Only draw if ring is present
-			if (!bricks[ring][brick] && hit_lerp[ring][brick] <= 0) continue;
+			if (!state.bricks[ring][brick] && state.hit_lerp[ring][brick] <= 0) continue;
 
 			glm::vec2 sec_angles = glm::vec2(BRICK_ANGLE *  brick + 1, 
 																			 BRICK_ANGLE * (brick + 1) - 1)
@@ -430,10 +447,10 @@ void MyMode::draw(glm::uvec2 const &drawable_size) {
 
 			// If the brick is destroyed but still being animated, adjust the drawing
 			// parameters
-			if (!bricks[ring][brick]) {
-				float lerp = 1 - (hit_lerp[ring][brick] / LERP_TIME);
+			if (!state.bricks[ring][brick]) {
+				float lerp = 1 - (state.hit_lerp[ring][brick] / LERP_TIME);
 
-				switch (hit_side[ring][brick]) {
+				switch (state.hit_side[ring][brick]) {
 				case INNER:
 					sec_radius.x += RING_WIDTH * lerp;
 					break;
@@ -452,104 +469,33 @@ void MyMode::draw(glm::uvec2 const &drawable_size) {
 				}
 			}
 
-			draw_sector(sec_center, sec_radius, sec_angles, fg_color);
+			batch_renderer->sector(sec_center, sec_radius, glm::vec2(DEG2RAD(sec_angles.x), DEG2RAD(sec_angles.y)), fg_color);
 		}
 	}
 
-	draw_circle(sec_center, 1, fg_color);
+	batch_renderer->circle(sec_center, 1, fg_color);
 
 	// Draw ball counter
-	for (int i = 0; i < ball_cnt; i++) {
+	for (int i = 0; i < state.latest.ball_cnt; i++) {
 		glm::vec2 pos(-court_radius.x, court_radius.y);
 
 		pos.x += i * GUI_BALL_RADIUS * 3;
 
-		draw_circle(pos, GUI_BALL_RADIUS, fg_color);
+		batch_renderer->circle(pos, GUI_BALL_RADIUS, fg_color);
 	}	
 
-	//------ compute court-to-window transform ------
-
-	//compute area that should be visible:
-	glm::vec2 scene_min = glm::vec2(
-		-court_radius.x - 2.0f * wall_radius - padding,
-		-court_radius.y - 2.0f * wall_radius - padding
-	);
-	glm::vec2 scene_max = glm::vec2(
-		court_radius.x + 2.0f * wall_radius + padding,
-		court_radius.y + 2.0f * wall_radius + padding
-	);
-
-	//compute window aspect ratio:
-	float aspect = drawable_size.x / float(drawable_size.y);
-	//we'll scale the x coordinate by 1.0 / aspect to make sure things stay square.
-
-	//compute scale factor for court given that...
-	float scale = std::min(
-		(2.0f * aspect) / (scene_max.x - scene_min.x), //... x must fit in [-aspect,aspect] ...
-		(2.0f) / (scene_max.y - scene_min.y) //... y must fit in [-1,1].
-	);
-
-	glm::vec2 center = 0.5f * (scene_max + scene_min);
-
-	//build matrix that scales and translates appropriately:
-	glm::mat4 court_to_clip = glm::mat4(
-		glm::vec4(scale / aspect, 0.0f, 0.0f, 0.0f),
-		glm::vec4(0.0f, scale, 0.0f, 0.0f),
-		glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
-		glm::vec4(-center.x * (scale / aspect), -center.y * scale, 0.0f, 1.0f)
-	);
-	//NOTE: glm matrices are specified in *Column-Major* order,
-	// so each line above is specifying a *column* of the matrix(!)
-
-	//also build the matrix that takes clip coordinates to court coordinates (used for mouse handling):
-	clip_to_court = glm::mat3x2(
-		glm::vec2(aspect / scale, 0.0f),
-		glm::vec2(0.0f, 1.0f / scale),
-		glm::vec2(center.x, center.y)
-	);
-
 	//---- actual drawing ----
 
-	//clear the color buffer:
-	glClearColor(bg_color.r / 255.0f, bg_color.g / 255.0f, bg_color.b / 255.0f, bg_color.a / 255.0f);
-	glClear(GL_COLOR_BUFFER_BIT);
-
-	//use alpha blending:
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	//don't use the depth test:
-	glDisable(GL_DEPTH_TEST);
-
-	//upload vertices to vertex_buffer:
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer); //set vertex_buffer as current
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STREAM_DRAW); //upload vertices array
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	//set color_texture_program as current program:
-	glUseProgram(color_texture_program.program);
-
-	//upload OBJECT_TO_CLIP to the proper uniform location:
-	glUniformMatrix4fv(color_texture_program.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(court_to_clip));
-
-	//use the mapping vertex_buffer_for_color_texture_program to fetch vertex data:
-	glBindVertexArray(vertex_buffer_for_color_texture_program);
-
-	//bind the solid white texture to location zero so things will be drawn just with their colors:
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, white_tex);
-
-	//run the OpenGL pipeline:
-	glDrawArrays(GL_TRIANGLES, 0, GLsizei(vertices.size()));
-
-	//unbind the solid white texture:
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	//reset vertex array to none:
-	glBindVertexArray(0);
+	{ //clear the color buffer:
+		GPUProfiler::Scope pass("clear");
+		glClearColor(bg_color.r / 255.0f, bg_color.g / 255.0f, bg_color.b / 255.0f, bg_color.a / 255.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
 
-	//reset current program to none:
-	glUseProgram(0);
-	
+	{ //sort, generate, and draw everything recorded above:
+		GPUProfiler::Scope pass("shapes");
+		batch_renderer->flush();
+	}
 
 	GL_ERRORS(); //PARANOIA: print errors just in case we did something wrong.
 
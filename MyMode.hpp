@@ -1,10 +1,10 @@
-#include "ColorTextureProgram.hpp"
-
 #include "Mode.hpp"
 #include "GL.hpp"
+#include "TripleBuffer.hpp"
 
 #include <glm/glm.hpp>
 
+#include <chrono>
 #include <vector>
 #include <deque>
 
@@ -16,6 +16,7 @@
 #define RING_WIDTH 0.9f
 #define LERP_TIME 0.1f
 #define GUI_BALL_RADIUS 0.1f
+#define SIM_RATE 240.0f
 
 enum Sides { INNER, OUTER, LEFT, RIGHT };
 
@@ -31,6 +32,7 @@ struct MyMode : Mode {
 	virtual bool handle_event(SDL_Event const &, glm::uvec2 const &window_size) override;
 	virtual void update(float elapsed) override;
 	virtual void draw(glm::uvec2 const &drawable_size) override;
+	virtual float simulation_rate() const override { return SIM_RATE; }
 
 	//----- game state -----
 
@@ -39,6 +41,11 @@ struct MyMode : Mode {
 	float mouse_angle = 0;
 	float sec_angle = 0;
 
+	//turns the rings to follow the mouse (clip space position):
+	void mouse_to(glm::vec2 clip_mouse);
+	glm::vec2 clip_mouse = glm::vec2(0.0f); //last mouse position (moved by raw motion when that's on)
+	glm::uvec2 window_size = glm::uvec2(0); //from the last event, for scaling raw motion
+
 	bool bricks[RINGS][BRICKS_PER_ROW];
 	Sides hit_side[RINGS][BRICKS_PER_ROW];
 	float hit_lerp[RINGS][BRICKS_PER_ROW];
@@ -50,29 +57,29 @@ struct MyMode : Mode {
 	glm::vec2 ball = glm::vec2(0.0f, 1.5f);
 	glm::vec2 ball_velocity = glm::vec2(0.5f, -1.5f);
 
-	//----- opengl assets / helpers ------
+	//----- state for drawing -----
 
-	//draw functions will work on vectors of vertices, defined as follows:
-	struct Vertex {
-		Vertex(glm::vec3 const &Position_, glm::u8vec4 const &Color_, glm::vec2 const &TexCoord_) :
-			Position(Position_), Color(Color_), TexCoord(TexCoord_) { }
-		glm::vec3 Position;
-		glm::u8vec4 Color;
-		glm::vec2 TexCoord;
+	//update (on the simulation thread) publishes everything draw needs after every tick:
+	struct Pose {
+		std::chrono::steady_clock::time_point time; //simulated time this pose is from
+		int ball_cnt;
+		float sec_angle;
+		glm::vec2 ball;
 	};
-	static_assert(sizeof(Vertex) == 4*3 + 1*4 + 4*2, "MyMode::Vertex should be packed");
-
-	//Shader program that draws transformed, vertices tinted with vertex colors:
-	ColorTextureProgram color_texture_program;
-
-	//Buffer used to hold vertex data during drawing:
-	GLuint vertex_buffer = 0;
+	struct Snapshot {
+		Pose previous; //as of the end of the tick before 'latest', so draw can interpolate from one snapshot
+		Pose latest;
+		bool bricks[RINGS][BRICKS_PER_ROW];
+		Sides hit_side[RINGS][BRICKS_PER_ROW];
+		float hit_lerp[RINGS][BRICKS_PER_ROW];
+	};
+	TripleBuffer< Snapshot > snapshots;
+	void publish_snapshot();
+	Pose tick_pose; //as of the end of the last tick (simulation thread only)
 
-	//Vertex Array Object that maps buffer locations to color_texture_program attribute locations:
-	GLuint vertex_buffer_for_color_texture_program = 0;
+	//----- opengl assets / helpers ------
 
-	//Solid white texture:
-	GLuint white_tex = 0;
+	//(GL objects and vertex generation live in the shared BatchRenderer)
 
 	//matrix that maps from clip coordinates to court-space coordinates:
 	glm::mat3x2 clip_to_court = glm::mat3x2(1.0f);
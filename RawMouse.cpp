@@ -0,0 +1,154 @@
+#include "RawMouse.hpp"
+
+#include "counters.hpp"
+#include "trace_zones.hpp"
+
+#include <iostream>
+
+#ifdef __linux__
+#include <linux/input.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <cstdio>
+#endif
+
+RawMouse *raw_mouse = nullptr;
+
+static Counter &raw_mouse_reports = counters.add("raw mouse reports");
+
+RawMouse::RawMouse() {
+}
+
+RawMouse::~RawMouse() {
+	stop();
+}
+
+void RawMouse::add(int32_t dx, int32_t dy) {
+	if (dx == 0 && dy == 0) return;
+	if (paused.load(std::memory_order_relaxed)) return;
+	uint64_t old = motion.load(std::memory_order_relaxed);
+	uint64_t sum;
+	do {
+		uint32_t x = uint32_t(old) + uint32_t(dx);
+		uint32_t y = uint32_t(old >> 32) + uint32_t(dy);
+		sum = (uint64_t(y) << 32) | uint64_t(x);
+	} while (!motion.compare_exchange_weak(old, sum, std::memory_order_relaxed));
+}
+
+glm::ivec2 RawMouse::take() {
+	uint64_t old = motion.exchange(0, std::memory_order_relaxed);
+	return glm::ivec2(int32_t(uint32_t(old)), int32_t(uint32_t(old >> 32)));
+}
+
+void RawMouse::set_paused(bool paused_) {
+	paused.store(paused_, std::memory_order_relaxed);
+	if (paused_) take(); //(motion from before the pause might belong to another window, too)
+}
+
+#ifdef __linux__
+
+bool RawMouse::start() {
+	stop();
+
+	//every device with relative X and Y axes counts as a mouse:
+	for (uint32_t i = 0; i < 32; ++i) {
+		char path[32];
+		std::snprintf(path, sizeof(path), "/dev/input/event%u", i);
+		int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+		if (fd < 0) continue;
+		unsigned long rel_bits = 0;
+		if (ioctl(fd, EVIOCGBIT(EV_REL, sizeof(rel_bits)), &rel_bits) >= 0
+		 && (rel_bits & (1ul << REL_X)) && (rel_bits & (1ul << REL_Y))) {
+			devices.emplace_back(fd);
+		} else {
+			close(fd);
+		}
+	}
+	if (devices.empty()) {
+		std::cerr << "NOTE: no readable evdev mice (is this user in the 'input' group?)." << std::endl;
+		return false;
+	}
+	if (pipe(wake_pipe) != 0) {
+		std::cerr << "NOTE: couldn't create a pipe for the raw mouse thread." << std::endl;
+		stop();
+		return false;
+	}
+
+	take(); //(start from no motion)
+	source = Evdev;
+	thread = std::thread(&RawMouse::run, this);
+	return true;
+}
+
+void RawMouse::stop() {
+	if (thread.joinable()) {
+		char byte = 0;
+		if (write(wake_pipe[1], &byte, 1) != 1) { /* the thread also checks 'source' */ }
+		source = None;
+		thread.join();
+	}
+	source = None;
+	for (int fd : devices) close(fd);
+	devices.clear();
+	for (int &fd : wake_pipe) {
+		if (fd >= 0) close(fd);
+		fd = -1;
+	}
+}
+
+void RawMouse::run() {
+	trace_thread_name("raw mouse");
+
+	std::vector< pollfd > fds(devices.size() + 1);
+	fds[0].fd = wake_pipe[0];
+	fds[0].events = POLLIN;
+	for (size_t i = 0; i < devices.size(); ++i) {
+		fds[i + 1].fd = devices[i];
+		fds[i + 1].events = POLLIN;
+	}
+
+	//per-device motion since the device's last SYN_REPORT:
+	std::vector< glm::ivec2 > pending(devices.size(), glm::ivec2(0));
+
+	while (source.load(std::memory_order_relaxed) == Evdev) {
+		if (poll(fds.data(), fds.size(), -1) < 0) continue;
+		if (fds[0].revents) break;
+
+		for (size_t i = 0; i < devices.size(); ++i) {
+			if (fds[i + 1].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+				fds[i + 1].fd = -1; //(unplugged; poll() skips negative fds)
+				continue;
+			}
+			if (!(fds[i + 1].revents & POLLIN)) continue;
+			input_event events[64];
+			ssize_t got;
+			while ((got = read(devices[i], events, sizeof(events))) > 0) {
+				for (size_t e = 0; e < size_t(got) / sizeof(input_event); ++e) {
+					input_event const &ev = events[e];
+					if (ev.type == EV_REL && ev.code == REL_X) pending[i].x += ev.value;
+					else if (ev.type == EV_REL && ev.code == REL_Y) pending[i].y += ev.value;
+					else if (ev.type == EV_SYN && ev.code == SYN_REPORT) {
+						//publish a whole report at once:
+						add(pending[i].x, pending[i].y);
+						pending[i] = glm::ivec2(0);
+						raw_mouse_reports.add(1);
+					}
+				}
+			}
+		}
+	}
+}
+
+#else //not linux
+
+bool RawMouse::start() {
+	return false;
+}
+
+void RawMouse::stop() {
+	source = None;
+}
+
+#endif
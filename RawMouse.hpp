@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * RawMouse collects relative mouse motion as the device reports it, without
+ *  waiting for the main loop to poll SDL events.
+ *
+ * On Linux, start() opens every evdev device (/dev/input/event*) that reports
+ *  relative X and Y (this needs read access, e.g. membership in the 'input'
+ *  group) and reads them on a dedicated thread at the device's own rate.
+ *  Elsewhere, or when no device can be opened, start() fails and the main
+ *  loop falls back to SDL relative mouse mode, add()ing each motion event's
+ *  xrel/yrel itself as it polls.
+ *
+ * Either way, motion accumulates in one lock-free atomic; a mode calls take()
+ *  as late as it can (e.g., at the start of each update) to get everything
+ *  since the last take(). Units are device counts, which are roughly pixels
+ *  but without pointer acceleration.
+ */
+
+struct RawMouse {
+	RawMouse();
+	~RawMouse();
+	RawMouse(RawMouse const &) = delete;
+	RawMouse &operator=(RawMouse const &) = delete;
+
+	enum Source : uint8_t {
+		None, //not running
+		Evdev, //input thread reading evdev devices
+		SDLRelative, //main loop feeding SDL relative motion
+	};
+
+	//opens devices and starts the input thread; returns 'false' (leaving source == None) if there are none:
+	bool start();
+	//or, with no usable devices, let the main loop add() SDL's relative motion:
+	void start_sdl_relative() { stop(); source = SDLRelative; }
+	void stop();
+
+	std::atomic< Source > source{None};
+
+	//any thread; motion since the last take():
+	void add(int32_t dx, int32_t dy);
+	glm::ivec2 take();
+
+	//evdev sees every mouse system-wide, so the main loop pauses collection while the window
+	// is unfocused or hidden; reports are dropped while paused, and pausing discards pending motion:
+	void set_paused(bool paused);
+
+private:
+	std::atomic< uint64_t > motion{0}; //dx in the low 32 bits, dy in the high 32 bits (each two's complement)
+	std::atomic< bool > paused{false};
+
+	#ifdef __linux__
+	std::vector< int > devices;
+	int wake_pipe[2] = { -1, -1 }; //written by stop() to interrupt the thread's poll()
+	std::thread thread;
+	void run();
+	#endif
+};
+
+//owned by main, which creates it before the game mode starts:
+extern RawMouse *raw_mouse;
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+/*
+ * SPSCQueue is a fixed-capacity ring buffer for passing values from exactly
+ *  one producer thread to exactly one consumer thread. push() and pop()
+ *  never lock or allocate; push() fails (and the caller decides what to do)
+ *  when the ring is full.
+ *
+ * Each side caches the other's index and only re-reads the shared atomic
+ *  when the cached one says the ring is full (or empty).
+ */
+
+template< typename T, uint32_t Capacity >
+struct SPSCQueue {
+	static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+
+	//producer thread only; returns 'false' if the queue is full:
+	bool push(T const &value) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail_cache == Capacity) {
+			tail_cache = tail.load(std::memory_order_acquire);
+			if (h - tail_cache == Capacity) return false;
+		}
+		items[h & (Capacity - 1)] = value;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	//consumer thread only; returns the oldest value, or nullptr if the queue is empty:
+	// (the value stays valid until pop())
+	T const *front() {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (head_cache == t) {
+			head_cache = head.load(std::memory_order_acquire);
+			if (head_cache == t) return nullptr;
+		}
+		return &items[t & (Capacity - 1)];
+	}
+	//removes the value front() returned:
+	void pop() {
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	//consumer thread only; copies out and removes the oldest value, or returns 'false' if empty:
+	bool pop(T &value) {
+		T const *f = front();
+		if (!f) return false;
+		value = *f;
+		pop();
+		return true;
+	}
+
+private:
+	T items[Capacity];
+
+	//(producer's and consumer's indices padded onto separate cache lines)
+	char padding0[64];
+	std::atomic< uint32_t > head{0}; //next slot to write
+	uint32_t tail_cache = 0; //producer's copy of 'tail'
+	char padding1[64];
+	std::atomic< uint32_t > tail{0}; //next slot to read
+	uint32_t head_cache = 0; //consumer's copy of 'head'
+};
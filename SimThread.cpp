@@ -0,0 +1,104 @@
+#include "SimThread.hpp"
+
+#include "alloc_tracking.hpp"
+#include "counters.hpp"
+#include "perf_counters.hpp"
+#include "trace_zones.hpp"
+
+#include <algorithm>
+
+static Counter &sim_ticks = counters.add("sim ticks");
+static Counter &sim_inputs_dropped = counters.add("sim inputs dropped");
+static Counter &sim_inputs_late = counters.add("sim inputs late");
+
+static PerfZoneStats sim_update_perf("sim update");
+
+constexpr std::chrono::milliseconds SimThread::ThrottledInterval;
+constexpr std::chrono::milliseconds SimThread::MaxCatchUp;
+constexpr std::chrono::milliseconds SimThread::InputDelay;
+
+SimThread::SimThread(std::shared_ptr< Mode > const &mode_, float rate)
+	: mode(mode_),
+	  tick(std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(1.0 / rate))),
+	  elapsed(1.0f / rate) {
+	sdl_epoch = Clock::now() - std::chrono::milliseconds(SDL_GetTicks());
+	thread = std::thread(&SimThread::run, this);
+}
+
+SimThread::~SimThread() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake_cv.notify_one();
+	thread.join();
+}
+
+bool SimThread::push(SDL_Event const &evt, glm::uvec2 const &window_size) {
+	Input input;
+	input.evt = evt;
+	input.window_size = window_size;
+	input.time = sdl_epoch + std::chrono::milliseconds(evt.common.timestamp);
+	if (!inputs.push(input)) {
+		sim_inputs_dropped.add(1);
+		return false;
+	}
+	return true;
+}
+
+void SimThread::run() {
+	trace_thread_name("sim");
+	ALLOC_TAG(AllocSim);
+	//(hardware counters are per thread; this makes the mode's own zones count, too)
+	perf_counters_open();
+
+	//(simulated time trails the wall clock by InputDelay, so inputs are queued before their time is simulated)
+	Clock::time_point next_tick = Clock::now() - InputDelay;
+	Clock::time_point last_wake = Clock::now();
+
+	while (true) {
+		{ //sleep until the next tick is due (or, when throttled, the next batch):
+			Clock::time_point wake = next_tick + tick + InputDelay;
+			if (throttled.load(std::memory_order_relaxed)) wake = std::max(wake, last_wake + ThrottledInterval);
+			std::unique_lock< std::mutex > lock(mutex);
+			wake_cv.wait_until(lock, wake, [this](){ return quit; });
+			if (quit) break;
+		}
+		last_wake = Clock::now();
+		Clock::time_point horizon = last_wake - InputDelay; //inputs stamped before this have been pushed
+		if (horizon - next_tick > MaxCatchUp) next_tick = horizon - MaxCatchUp;
+
+		//run every tick that has come due:
+		uint64_t ticks = 0;
+		while (next_tick + tick <= horizon && !mode->finished.load(std::memory_order_relaxed)) {
+			TRACE_ZONE("sim tick");
+			Clock::time_point tick_end = next_tick + tick;
+			Clock::time_point at = next_tick; //how far this tick has been simulated
+			auto step_to = [&](Clock::time_point until) {
+				if (until <= at) return;
+				PerfZone perf(sim_update_perf);
+				mode->simulated_time = until;
+				mode->simulated_tick_end = (until == tick_end);
+				mode->update(until == tick_end && at == next_tick ? elapsed : std::chrono::duration< float >(until - at).count());
+				at = until;
+			};
+			//step to each input that falls in this tick, then apply it:
+			while (Input const *input = inputs.front()) {
+				if (input->time >= tick_end) break; //(that's a later tick's input)
+				if (input->time < at) sim_inputs_late.add(1);
+				step_to(input->time);
+				mode->handle_event(input->evt, input->window_size);
+				inputs.pop();
+			}
+			step_to(tick_end);
+			next_tick = tick_end;
+			ticks += 1;
+		}
+		sim_ticks.add(ticks);
+
+		//(the main loop notices and switches modes, which stops this thread)
+		if (mode->finished.load(std::memory_order_relaxed)) next_tick = last_wake + ThrottledInterval;
+	}
+
+	perf_counters_close();
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Mode.hpp"
+#include "SPSCQueue.hpp"
+
+#include <SDL.h>
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*
+ * SimThread runs a mode's handle_event and update on their own thread, at a
+ *  fixed rate (Mode::simulation_rate()) that doesn't depend on how long frames
+ *  take to draw or how long the swap blocks for vsync.
+ *
+ * The main loop push()es every SDL event, along with its timestamp. Each
+ *  tick steps the simulation to each input's time with update(), applies
+ *  the input with handle_event (whose return value is ignored), and finally
+ *  steps to the end of the tick; so a tick with no input is one update of
+ *  1 / rate seconds, and motion during a tick follows the real input path.
+ *  Since the main loop only polls events once per frame, simulated time runs
+ *  InputDelay behind the wall clock, so an input is normally queued before
+ *  its time comes up; inputs that still arrive after their time has been
+ *  simulated (e.g., from a slow or throttled frame) apply at the current point.
+ *  The mode publishes whatever draw() needs (e.g., through a TripleBuffer) at
+ *  the end of update; draw(), still on the main thread, must not touch
+ *  anything else update writes.
+ *
+ * A mode that wants to end sets Mode::finished rather than calling
+ *  Mode::set_current, which belongs to the main thread.
+ */
+
+struct SimThread {
+	using Clock = std::chrono::steady_clock;
+
+	//starts ticking 'mode' right away:
+	SimThread(std::shared_ptr< Mode > const &mode, float rate);
+	//stops and joins the thread:
+	~SimThread();
+	SimThread(SimThread const &) = delete;
+	SimThread &operator=(SimThread const &) = delete;
+
+	//main thread; returns 'false' (and counts a drop) if the queue is full:
+	bool push(SDL_Event const &evt, glm::uvec2 const &window_size);
+
+	//while set (e.g., window hidden), due ticks run in batches a few times a second instead of as they come due:
+	std::atomic< bool > throttled{false};
+
+	std::shared_ptr< Mode > const mode;
+	Clock::duration const tick;
+	float const elapsed; //seconds per tick
+
+	//ticks wake the thread at most this often while throttled:
+	static constexpr std::chrono::milliseconds ThrottledInterval{100};
+	//after a stall longer than this (e.g., a debugger break), ticks are skipped rather than caught up:
+	static constexpr std::chrono::milliseconds MaxCatchUp{250};
+	//how far simulated time trails the wall clock (more than a frame, plus SDL's millisecond timestamps):
+	static constexpr std::chrono::milliseconds InputDelay{25};
+
+private:
+	void run();
+
+	struct Input {
+		SDL_Event evt;
+		glm::uvec2 window_size;
+		Clock::time_point time; //from the event's SDL timestamp
+	};
+	SPSCQueue< Input, 1024 > inputs;
+	Clock::time_point sdl_epoch; //when SDL_GetTicks() was zero (SDL timestamps are milliseconds since then)
+
+	std::mutex mutex; //guards 'quit' (and is used to sleep between ticks)
+	std::condition_variable wake_cv;
+	bool quit = false;
+
+	std::thread thread;
+};
@@ -0,0 +1,315 @@
+#include "TextureCache.hpp"
+
+#include "MappedFile.hpp"
+#include "alloc_tracking.hpp"
+#include "gl_state.hpp"
+#include "trace_zones.hpp"
+
+//for the GL_ERRORS() macro:
+#include "gl_errors.hpp"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+//---- cache file layout ----
+//(native byte order; a cache file is only ever read on the machine that wrote it, or one like it)
+
+enum : uint32_t {
+	MaxLevels = 16, //(up to 32768x32768)
+	LevelAlignment = 16,
+};
+
+struct CacheHeader {
+	char magic[8]; //"TEXCACH1" ('1' is the version)
+	uint32_t format; //TextureFormat
+	uint32_t origin; //OriginLocation
+	uint32_t levels;
+	uint32_t padding;
+	//the PNG this was built from:
+	uint64_t source_size;
+	int64_t source_mtime;
+	uint64_t source_hash;
+	struct Level {
+		uint32_t width, height;
+		uint64_t offset, bytes; //in the file
+	} level[MaxLevels];
+};
+static_assert(sizeof(CacheHeader) == 48 + MaxLevels * 24, "cache header has no hidden padding");
+
+static char const CacheMagic[8] = { 'T', 'E', 'X', 'C', 'A', 'C', 'H', '1' };
+
+//FNV-1a:
+static uint64_t hash_bytes(uint8_t const *data, size_t size) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ data[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static size_t level_bytes(TextureFormat format, glm::uvec2 size) {
+	if (format == TextureMaskRGTC1) return size_t((size.x + 3) / 4) * ((size.y + 3) / 4) * 8;
+	return size_t(size.x) * size.y * 4;
+}
+
+//the header, if 'blob' is a well-formed cache of the requested kind:
+static CacheHeader const *check_cache(uint8_t const *blob, size_t size, TextureFormat format, OriginLocation origin) {
+	if (size < sizeof(CacheHeader)) return nullptr;
+	CacheHeader const *header = reinterpret_cast< CacheHeader const * >(blob);
+	if (std::memcmp(header->magic, CacheMagic, 8) != 0) return nullptr;
+	if (header->format != format || header->origin != origin) return nullptr;
+	if (header->levels == 0 || header->levels > MaxLevels) return nullptr;
+	for (uint32_t l = 0; l < header->levels; ++l) {
+		CacheHeader::Level const &level = header->level[l];
+		if (level.bytes != level_bytes(format, glm::uvec2(level.width, level.height))) return nullptr;
+		if (level.offset > size || level.bytes > size - level.offset) return nullptr; //(truncated file)
+	}
+	return header;
+}
+
+//---- building ----
+
+//2x2 box filter; an odd last row or column is folded into the last box, which becomes 3 texels wide:
+static void halve(glm::uvec2 size, std::vector< glm::u8vec4 > const &src, glm::uvec2 *out_size, std::vector< glm::u8vec4 > *out) {
+	*out_size = glm::uvec2(std::max(1u, size.x / 2), std::max(1u, size.y / 2));
+	out->resize(size_t(out_size->x) * out_size->y);
+	//source span [begin, end) feeding output index i along an axis of length 'in' -> 'out':
+	auto span = [](uint32_t i, uint32_t in, uint32_t out, uint32_t *begin, uint32_t *end) {
+		*begin = std::min(2 * i, in - 1);
+		*end = (i + 1 == out ? in : 2 * i + 2);
+	};
+	for (uint32_t y = 0; y < out_size->y; ++y) {
+		uint32_t y_begin, y_end;
+		span(y, size.y, out_size->y, &y_begin, &y_end);
+		for (uint32_t x = 0; x < out_size->x; ++x) {
+			uint32_t x_begin, x_end;
+			span(x, size.x, out_size->x, &x_begin, &x_end);
+			uint32_t r = 0, g = 0, b = 0, a = 0;
+			for (uint32_t sy = y_begin; sy < y_end; ++sy) {
+				for (uint32_t sx = x_begin; sx < x_end; ++sx) {
+					glm::u8vec4 const &t = src[size_t(sy) * size.x + sx];
+					r += t.r; g += t.g; b += t.b; a += t.a;
+				}
+			}
+			uint32_t count = (y_end - y_begin) * (x_end - x_begin);
+			(*out)[size_t(y) * out_size->x + x] = glm::u8vec4(
+				uint8_t((r + count / 2) / count),
+				uint8_t((g + count / 2) / count),
+				uint8_t((b + count / 2) / count),
+				uint8_t((a + count / 2) / count)
+			);
+		}
+	}
+}
+
+//one RGTC1 (a.k.a. BC4) block: two endpoints, then a 3-bit palette index per texel:
+static void rgtc1_block(uint8_t const values[16], uint8_t out[8]) {
+	uint8_t lo = 0xff, hi = 0;
+	for (uint32_t t = 0; t < 16; ++t) {
+		lo = std::min(lo, values[t]);
+		hi = std::max(hi, values[t]);
+	}
+	//(with endpoint 0 > endpoint 1, the palette is both endpoints and six steps between them)
+	out[0] = hi;
+	out[1] = lo;
+	uint8_t palette[8] = { hi, lo };
+	for (uint32_t i = 2; i < 8; ++i) {
+		palette[i] = uint8_t(((8 - i) * hi + (i - 1) * lo + 3) / 7);
+	}
+	uint64_t bits = 0;
+	if (hi != lo) {
+		for (uint32_t t = 0; t < 16; ++t) {
+			uint32_t best = 0;
+			int best_error = 256;
+			for (uint32_t i = 0; i < 8; ++i) {
+				int error = std::abs(int(palette[i]) - int(values[t]));
+				if (error < best_error) {
+					best = i;
+					best_error = error;
+				}
+			}
+			bits |= uint64_t(best) << (3 * t);
+		}
+	}
+	for (uint32_t i = 0; i < 6; ++i) {
+		out[2 + i] = uint8_t(bits >> (8 * i));
+	}
+}
+
+static void compress_rgtc1_alpha(glm::uvec2 size, std::vector< glm::u8vec4 > const &src, uint8_t *out) {
+	uint32_t blocks_x = (size.x + 3) / 4, blocks_y = (size.y + 3) / 4;
+	for (uint32_t by = 0; by < blocks_y; ++by) {
+		for (uint32_t bx = 0; bx < blocks_x; ++bx) {
+			uint8_t values[16];
+			for (uint32_t t = 0; t < 16; ++t) {
+				//(blocks hanging off the edge repeat the edge texels)
+				uint32_t x = std::min(4 * bx + t % 4, size.x - 1);
+				uint32_t y = std::min(4 * by + t / 4, size.y - 1);
+				values[t] = src[size_t(y) * size.x + x].a;
+			}
+			rgtc1_block(values, out);
+			out += 8;
+		}
+	}
+}
+
+//decode the PNG and lay out the whole cache file in memory:
+static void build_cache(std::string const &png_path, OriginLocation origin, TextureFormat format, std::vector< uint8_t > *blob_) {
+	TRACE_ZONE("build texture cache");
+	ALLOC_TAG(AllocPNG);
+	std::vector< uint8_t > &blob = *blob_;
+
+	MappedFile png(png_path);
+	glm::uvec2 size;
+	std::vector< glm::u8vec4 > pixels;
+	load_png(png_path, &size, &pixels, origin);
+	if (size.x == 0 || size.y == 0 || std::max(size.x, size.y) >= (1u << MaxLevels)) {
+		throw std::runtime_error("PNG image '" + png_path + "' is an unsupported size for a texture.");
+	}
+
+	CacheHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, CacheMagic, 8);
+	header.format = format;
+	header.origin = origin;
+	header.source_size = png.size;
+	header.source_hash = hash_bytes(png.data, png.size);
+	//(source_mtime is filled in by the caller, which has already stat'd the PNG)
+
+	blob.assign(sizeof(CacheHeader), 0);
+	std::vector< glm::u8vec4 > smaller;
+	while (true) {
+		CacheHeader::Level &level = header.level[header.levels];
+		level.width = size.x;
+		level.height = size.y;
+		level.offset = (blob.size() + LevelAlignment - 1) / LevelAlignment * LevelAlignment;
+		level.bytes = level_bytes(format, size);
+		blob.resize(size_t(level.offset + level.bytes), 0);
+		uint8_t *dest = &blob[size_t(level.offset)];
+		if (format == TextureMaskRGTC1) {
+			compress_rgtc1_alpha(size, pixels, dest);
+		} else {
+			std::memcpy(dest, pixels.data(), size_t(level.bytes));
+		}
+		header.levels += 1;
+
+		if (size.x == 1 && size.y == 1) break;
+		halve(size, pixels, &size, &smaller);
+		pixels.swap(smaller);
+	}
+	std::memcpy(blob.data(), &header, sizeof(header));
+}
+
+//write to a temporary file first, so a half-written cache is never picked up:
+static void write_cache(std::string const &cache_path, std::vector< uint8_t > const &blob) {
+	std::string temp_path = cache_path + ".tmp";
+	{
+		std::ofstream file(temp_path, std::ios::binary);
+		file.write(reinterpret_cast< char const * >(blob.data()), blob.size());
+		if (!file) {
+			std::cerr << "NOTE: couldn't write texture cache '" << temp_path << "'; will rebuild it next time." << std::endl;
+			return;
+		}
+	}
+	std::remove(cache_path.c_str()); //(rename won't replace an existing file on Windows)
+	if (std::rename(temp_path.c_str(), cache_path.c_str()) != 0) {
+		std::cerr << "NOTE: couldn't rename '" << temp_path << "' to '" << cache_path << "'." << std::endl;
+		std::remove(temp_path.c_str());
+	}
+}
+
+//---- uploading ----
+
+static GLuint upload(uint8_t const *blob, CacheHeader const &header) {
+	TRACE_ZONE("upload texture");
+	GLuint tex = 0;
+	glGenTextures(1, &tex);
+	gl_state.bind_texture(GL_TEXTURE_2D, tex);
+	gl_state.bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0); //(levels come from client memory)
+
+	for (uint32_t l = 0; l < header.levels; ++l) {
+		CacheHeader::Level const &level = header.level[l];
+		if (header.format == TextureMaskRGTC1) {
+			glCompressedTexImage2D(GL_TEXTURE_2D, l, GL_COMPRESSED_RED_RGTC1, level.width, level.height, 0, GLsizei(level.bytes), blob + level.offset);
+		} else {
+			//(rows are whole pixels, so the default 4-byte unpack alignment fits)
+			glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA8, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, blob + level.offset);
+		}
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	if (header.format == TextureMaskRGTC1) {
+		//the single (red) channel is the mask; sample as white with that alpha:
+		GLint swizzle[4] = { GL_ONE, GL_ONE, GL_ONE, GL_RED };
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	}
+
+	gl_state.bind_texture(GL_TEXTURE_2D, 0);
+
+	GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
+	return tex;
+}
+
+GLuint load_texture(std::string const &png_path, OriginLocation origin, TextureFormat format) {
+	TRACE_ZONE("load_texture");
+	std::string cache_path = png_path + ".tex";
+
+	struct stat png_info;
+	bool have_png = (stat(png_path.c_str(), &png_info) == 0);
+
+	//use the cache, if it is there and still matches the PNG:
+	struct stat cache_info;
+	if (stat(cache_path.c_str(), &cache_info) == 0) {
+		std::unique_ptr< MappedFile > cache;
+		try {
+			cache.reset(new MappedFile(cache_path));
+		} catch (std::exception &e) {
+			std::cerr << "NOTE: " << e.what() << " Rebuilding it." << std::endl;
+		}
+		CacheHeader const *header = (cache ? check_cache(cache->data, cache->size, format, origin) : nullptr);
+		bool fresh = header && (!have_png || (
+			header->source_size == uint64_t(png_info.st_size)
+			&& header->source_mtime == int64_t(png_info.st_mtime)
+		));
+		if (header && !fresh && have_png && header->source_size == uint64_t(png_info.st_size)) {
+			//touched (e.g., by a checkout), maybe not changed; the contents decide:
+			MappedFile png(png_path);
+			if (hash_bytes(png.data, png.size) == header->source_hash) {
+				fresh = true;
+				//(remember the new time, so the next load skips the hash)
+				int64_t mtime = int64_t(png_info.st_mtime);
+				std::fstream patch(cache_path, std::ios::in | std::ios::out | std::ios::binary);
+				patch.seekp(offsetof(CacheHeader, source_mtime));
+				patch.write(reinterpret_cast< char const * >(&mtime), sizeof(mtime));
+			}
+		}
+		if (fresh) return upload(cache->data, *header);
+	}
+
+	if (!have_png) {
+		throw std::runtime_error("Failed to find texture '" + png_path + "' (or a usable '" + cache_path + "').");
+	}
+
+	std::vector< uint8_t > blob;
+	build_cache(png_path, origin, format, &blob);
+	reinterpret_cast< CacheHeader * >(blob.data())->source_mtime = int64_t(png_info.st_mtime);
+	write_cache(cache_path, blob);
+	std::cout << "Built texture cache '" << cache_path << "'." << std::endl;
+
+	return upload(blob.data(), *reinterpret_cast< CacheHeader const * >(blob.data()));
+}
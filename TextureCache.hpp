@@ -0,0 +1,35 @@
+#pragma once
+
+#include "GL.hpp"
+#include "load_save_png.hpp"
+
+#include <string>
+#include <stdint.h>
+
+/*
+ * load_texture() loads a PNG as a mipmapped GL_TEXTURE_2D by way of a
+ *  GPU-ready cache file beside it ("<png>.tex"):
+ *
+ *  - The first load decodes the PNG, flips it to the requested origin,
+ *    builds the whole mip chain (compressing every level, for masks), and
+ *    writes it all out as a header plus one block per level.
+ *  - Later loads compare the PNG's size and modification time to the ones
+ *    in the cache header (hashing the PNG only when the time has moved but
+ *    the size hasn't), map the cache file, and upload each level straight
+ *    from the mapping: no PNG decode, no glGenerateMipmap.
+ *
+ * If the PNG is missing but its cache file isn't, the cache is used as-is
+ *  (so a build can ship just the .tex files).
+ *
+ * Loading is per texture and on demand -- a stat and a map when the cache is
+ *  fresh; nothing scans or indexes all assets up front.
+ */
+
+enum TextureFormat : uint8_t {
+	TextureRGBA8,
+	TextureMaskRGTC1, //the PNG's alpha only, RGTC1-compressed (1/8th the size); samples as white with that alpha (text, masks)
+};
+
+//NOTE: load_texture will throw on error
+//returns a new texture object (bound to nothing; delete with glDeleteTextures and gl_state.deleted_texture):
+GLuint load_texture(std::string const &png_path, OriginLocation origin, TextureFormat format = TextureRGBA8);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+/*
+ * TripleBuffer hands the latest value from one writer thread to one reader
+ *  thread without locks or waiting: the writer fills write() and publish()es
+ *  it; the reader calls acquire() and then looks at read().
+ *
+ * Three slots means each side always owns one, and the third (the "shared"
+ *  slot) is swapped in and out with a single atomic exchange. Values the
+ *  reader never acquired are simply overwritten, so the reader always sees
+ *  the newest one.
+ *
+ * Note that the slot write() returns after a publish() holds an older value,
+ *  not the one just published; the writer should fill in all of it.
+ */
+
+template< typename T >
+struct TripleBuffer {
+	//writer thread only:
+	T &write() { return slots[write_index].value; }
+	void publish() {
+		uint8_t previous = shared.exchange(write_index | Fresh, std::memory_order_acq_rel);
+		write_index = previous & IndexMask;
+	}
+
+	//reader thread only; returns 'true' if a newer value is now in read():
+	bool acquire() {
+		if (!(shared.load(std::memory_order_relaxed) & Fresh)) return false;
+		uint8_t previous = shared.exchange(read_index, std::memory_order_acq_rel);
+		read_index = previous & IndexMask;
+		return true;
+	}
+	T const &read() const { return slots[read_index].value; }
+
+private:
+	enum : uint8_t { IndexMask = 0x3, Fresh = 0x4 };
+
+	//(slots are padded apart so the two threads don't false-share; padding rather than
+	// alignas, since over-aligned types can't be heap-allocated before C++17)
+	struct Slot {
+		T value;
+		char padding[64];
+	};
+	Slot slots[3];
+
+	std::atomic< uint8_t > shared{1}; //slot index, plus 'Fresh' if the writer has published into it since the reader last looked
+	uint8_t write_index = 0; //(writer's)
+	char padding[64];
+	uint8_t read_index = 2; //(reader's)
+};
@@ -0,0 +1,147 @@
+#include "alloc_tracking.hpp"
+
+#ifdef ENABLE_ALLOC_TRACKING
+
+#include "counters.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <new>
+
+namespace {
+
+//all of this is constant-initialized, since allocations can happen before main():
+
+struct TagStats {
+	std::atomic< uint64_t > allocations{0};
+	std::atomic< uint64_t > bytes{0};
+	std::atomic< uint64_t > live_bytes{0};
+	std::atomic< uint64_t > peak_live_bytes{0};
+
+	//main thread only (alloc_tracking_begin_frame):
+	uint64_t frame_start_allocations = 0;
+	uint64_t peak_frame_allocations = 0;
+};
+TagStats tag_stats[AllocTagCount];
+
+char const *tag_names[AllocTagCount] = { "other", "render", "sim", "png", "input" };
+
+thread_local AllocTag current_tag = AllocOther;
+thread_local uint64_t thread_allocations = 0;
+
+//every block starts with a header, which keeps the returned pointer max-aligned:
+struct alignas(16) Header {
+	size_t size;
+	AllocTag tag;
+};
+static_assert(sizeof(Header) == 16, "allocation header should be 16 bytes");
+
+void *tracked_alloc(size_t size) {
+	Header *header = static_cast< Header * >(std::malloc(sizeof(Header) + size));
+	if (!header) return nullptr;
+	header->size = size;
+	header->tag = current_tag;
+
+	TagStats &stats = tag_stats[header->tag];
+	stats.allocations.fetch_add(1, std::memory_order_relaxed);
+	stats.bytes.fetch_add(size, std::memory_order_relaxed);
+	uint64_t live = stats.live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+	uint64_t peak = stats.peak_live_bytes.load(std::memory_order_relaxed);
+	while (live > peak && !stats.peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) { }
+	thread_allocations += 1;
+
+	return header + 1;
+}
+
+void tracked_free(void *ptr) {
+	if (!ptr) return;
+	Header *header = static_cast< Header * >(ptr) - 1;
+	tag_stats[header->tag].live_bytes.fetch_sub(header->size, std::memory_order_relaxed);
+	std::free(header);
+}
+
+void *tracked_new(size_t size) {
+	//(operator new must return a unique pointer even for zero bytes)
+	void *ptr = tracked_alloc(size ? size : 1);
+	if (!ptr) throw std::bad_alloc();
+	return ptr;
+}
+
+//per-frame allocations for each tag, on the HUD (no new/delete involved in registering):
+Counter &hud_counters(uint32_t tag) {
+	static Counter *counters_by_tag[AllocTagCount] = {
+		&counters.add("allocs other"),
+		&counters.add("allocs render"),
+		&counters.add("allocs sim"),
+		&counters.add("allocs png"),
+		&counters.add("allocs input"),
+	};
+	return *counters_by_tag[tag];
+}
+
+} //namespace
+
+//---- global allocation functions ----
+
+void *operator new(size_t size) { return tracked_new(size); }
+void *operator new[](size_t size) { return tracked_new(size); }
+void *operator new(size_t size, std::nothrow_t const &) noexcept { return tracked_alloc(size ? size : 1); }
+void *operator new[](size_t size, std::nothrow_t const &) noexcept { return tracked_alloc(size ? size : 1); }
+
+void operator delete(void *ptr) noexcept { tracked_free(ptr); }
+void operator delete[](void *ptr) noexcept { tracked_free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { tracked_free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { tracked_free(ptr); }
+void operator delete(void *ptr, std::nothrow_t const &) noexcept { tracked_free(ptr); }
+void operator delete[](void *ptr, std::nothrow_t const &) noexcept { tracked_free(ptr); }
+
+//---- tags and budgets ----
+
+AllocTagScope::AllocTagScope(AllocTag tag) : previous(current_tag) {
+	current_tag = tag;
+}
+
+AllocTagScope::~AllocTagScope() {
+	current_tag = previous;
+}
+
+AllocBudgetScope::AllocBudgetScope(char const *what_, uint64_t max_allocations_) : what(what_), max_allocations(max_allocations_), start(thread_allocations) {
+}
+
+AllocBudgetScope::~AllocBudgetScope() {
+	uint64_t used = thread_allocations - start;
+	if (used > max_allocations) {
+		std::cerr << "Allocation budget exceeded: '" << what << "' made " << used << " heap allocations (budget " << max_allocations << ")." << std::endl;
+		assert(used <= max_allocations && "allocation budget exceeded");
+	}
+}
+
+//---- reporting ----
+
+void alloc_tracking_begin_frame() {
+	for (uint32_t tag = 0; tag < AllocTagCount; ++tag) {
+		TagStats &stats = tag_stats[tag];
+		uint64_t allocations = stats.allocations.load(std::memory_order_relaxed);
+		uint64_t frame = allocations - stats.frame_start_allocations;
+		stats.frame_start_allocations = allocations;
+		if (frame > stats.peak_frame_allocations) stats.peak_frame_allocations = frame;
+		hud_counters(tag).add(frame);
+	}
+}
+
+void alloc_tracking_report(std::ostream &out) {
+	out << "Heap allocations by tag:\n";
+	for (uint32_t tag = 0; tag < AllocTagCount; ++tag) {
+		TagStats const &stats = tag_stats[tag];
+		out << "  " << std::setw(7) << std::left << tag_names[tag] << std::right
+		    << " allocations " << std::setw(9) << stats.allocations.load(std::memory_order_relaxed)
+		    << "  bytes " << std::setw(11) << stats.bytes.load(std::memory_order_relaxed)
+		    << "  peak live bytes " << std::setw(10) << stats.peak_live_bytes.load(std::memory_order_relaxed)
+		    << "  peak per frame " << stats.peak_frame_allocations << "\n";
+	}
+}
+
+#endif //ENABLE_ALLOC_TRACKING
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <iosfwd>
+#include <stdint.h>
+
+/*
+ * Opt-in heap allocation tracking (define ENABLE_ALLOC_TRACKING; see the Jamfile).
+ *
+ * When enabled, alloc_tracking.cpp replaces the global operator new/delete and
+ *  attributes every allocation to the calling thread's current tag:
+ *
+ *   ALLOC_TAG(AllocSim); //allocations until the end of this scope count as "sim"
+ *   ALLOC_BUDGET("MyMode::update", 0); //assert if this scope allocates at all
+ *
+ * Per-tag totals, per-frame counts, and peaks are published to the debug HUD
+ *  and printed by alloc_tracking_report(). When disabled, the macros compile
+ *  to nothing.
+ */
+
+enum AllocTag : uint8_t {
+	AllocOther,
+	AllocRender,
+	AllocSim,
+	AllocPNG,
+	AllocInput,
+	AllocTagCount
+};
+
+#ifdef ENABLE_ALLOC_TRACKING
+
+struct AllocTagScope {
+	AllocTagScope(AllocTag tag);
+	~AllocTagScope();
+	AllocTagScope(AllocTagScope const &) = delete;
+	AllocTagScope &operator=(AllocTagScope const &) = delete;
+	AllocTag previous;
+};
+
+struct AllocBudgetScope {
+	AllocBudgetScope(char const *what, uint64_t max_allocations);
+	~AllocBudgetScope();
+	AllocBudgetScope(AllocBudgetScope const &) = delete;
+	AllocBudgetScope &operator=(AllocBudgetScope const &) = delete;
+	char const *what;
+	uint64_t max_allocations;
+	uint64_t start; //this thread's allocation count when the scope began
+};
+
+//called by the main loop once per frame:
+void alloc_tracking_begin_frame();
+
+//per-tag allocations, bytes, and peaks since startup:
+void alloc_tracking_report(std::ostream &out);
+
+#define ALLOC_SCOPE_NAME2(PREFIX, LINE) PREFIX ## LINE
+#define ALLOC_SCOPE_NAME(PREFIX, LINE) ALLOC_SCOPE_NAME2(PREFIX, LINE)
+#define ALLOC_TAG(TAG) AllocTagScope ALLOC_SCOPE_NAME(alloc_tag_, __LINE__)(TAG)
+#define ALLOC_BUDGET(WHAT, MAX) AllocBudgetScope ALLOC_SCOPE_NAME(alloc_budget_, __LINE__)(WHAT, MAX)
+
+#else //ENABLE_ALLOC_TRACKING
+
+inline void alloc_tracking_begin_frame() { }
+inline void alloc_tracking_report(std::ostream &) { }
+
+#define ALLOC_TAG(TAG) do { } while (0)
+#define ALLOC_BUDGET(WHAT, MAX) do { } while (0)
+
+#endif //ENABLE_ALLOC_TRACKING
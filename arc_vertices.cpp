@@ -0,0 +1,223 @@
+#include "arc_vertices.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ARC_VERTICES_SSE
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#endif
+
+//----- compile-time unit circle -----
+
+//Taylor series for sin/cos on [0, pi/2], accurate to well past float precision:
+static constexpr double taylor_sin(double x) {
+	double term = x;
+	double sum = x;
+	for (int n = 1; n < 12; ++n) {
+		term *= -x * x / ((2 * n) * (2 * n + 1));
+		sum += term;
+	}
+	return sum;
+}
+static constexpr double taylor_cos(double x) {
+	double term = 1.0;
+	double sum = 1.0;
+	for (int n = 1; n < 12; ++n) {
+		term *= -x * x / ((2 * n - 1) * (2 * n));
+		sum += term;
+	}
+	return sum;
+}
+
+//(cos, sin) of 2*pi*i/UNIT_CIRCLE_STEPS for i in [0, UNIT_CIRCLE_STEPS]:
+struct UnitCircle {
+	float xy[2 * (UNIT_CIRCLE_STEPS + 1)];
+
+	constexpr UnitCircle() : xy() {
+		constexpr uint32_t Quarter = UNIT_CIRCLE_STEPS / 4;
+		for (uint32_t i = 0; i <= UNIT_CIRCLE_STEPS; ++i) {
+			//evaluate within the first quadrant, then rotate by whole quarter turns:
+			uint32_t quadrant = (i / Quarter) % 4;
+			double angle = (i % Quarter) * (2.0 * 3.14159265358979323846 / UNIT_CIRCLE_STEPS);
+			double c = taylor_cos(angle);
+			double s = taylor_sin(angle);
+			for (uint32_t q = 0; q < quadrant; ++q) {
+				double t = c;
+				c = -s;
+				s = t;
+			}
+			xy[2 * i + 0] = float(c);
+			xy[2 * i + 1] = float(s);
+		}
+	}
+};
+static_assert(UNIT_CIRCLE_STEPS % 4 == 0, "unit circle table is built from quarter turns");
+
+static constexpr UnitCircle unit_circle{};
+
+static constexpr float TableStep = float(2.0 * 3.14159265358979323846 / UNIT_CIRCLE_STEPS);
+
+float arc_max_step(float radius, float max_error) {
+	//arcs smaller than the error bound can be covered by a single segment:
+	if (radius <= max_error) return float(2.0 * 3.14159265358979323846);
+
+	//sagitta = r * (1 - cos(step / 2))  =>  step = 2 * acos(1 - error / r)
+	return 2.0f * acosf(1.0f - max_error / radius);
+}
+
+ArcSteps arc_steps(float span, float max_step) {
+	ArcSteps steps;
+	while (steps.stride * 2 <= UNIT_CIRCLE_STEPS && steps.stride * 2 * TableStep <= max_step) {
+		steps.stride *= 2;
+	}
+	//(the small bias keeps exact multiples -- e.g., full circles -- from picking up a sliver segment)
+	float segments = ceilf(span / (steps.stride * TableStep) - 1e-4f);
+	steps.segments = (segments < 1.0f ? 1 : uint32_t(segments));
+	return steps;
+}
+
+//----- four-wide float helpers -----
+//Each vertex is 6 floats: x y 0 color | 0.5 0.5; two vertices fill exactly three 16-byte stores.
+
+#ifdef ARC_VERTICES_SSE
+
+typedef __m128 Quad;
+
+static inline Quad quad(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+static inline Quad quad_bits(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+	return _mm_castsi128_ps(_mm_setr_epi32(int32_t(a), int32_t(b), int32_t(c), int32_t(d)));
+}
+//(x, y, x, y) from a table entry:
+//(the pair is copied through a double so the 8-byte load needs neither alignment nor type punning)
+static inline Quad quad_dup2(float const *xy) {
+	double pair;
+	std::memcpy(&pair, xy, sizeof(pair));
+	return _mm_castpd_ps(_mm_set1_pd(pair));
+}
+static inline Quad add(Quad a, Quad b) { return _mm_add_ps(a, b); }
+static inline Quad mul(Quad a, Quad b) { return _mm_mul_ps(a, b); }
+//(a0, a1, b0, b1):
+static inline Quad low_low(Quad a, Quad b) { return _mm_movelh_ps(a, b); }
+//(b2, b3, a2, a3):
+static inline Quad high_high(Quad a, Quad b) { return _mm_movehl_ps(a, b); }
+//(a2, a3, a0, a1):
+static inline Quad swap_halves(Quad a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(1,0,3,2)); }
+//(-a1, a0, -a3, a2) -- multiplying by i:
+static inline Quad perp(Quad a) { return _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2,3,0,1)), _mm_setr_ps(-1.0f, 1.0f, -1.0f, 1.0f)); }
+static inline void store(float *out, Quad a) { _mm_storeu_ps(out, a); }
+static inline void store_low(float *out, Quad a) { _mm_storel_pi(reinterpret_cast< __m64 * >(out), a); }
+
+#else //portable fallback with the same semantics:
+
+struct Quad { float v[4]; };
+
+static inline Quad quad(float a, float b, float c, float d) { return Quad{{a, b, c, d}}; }
+static inline Quad quad_bits(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+	uint32_t bits[4] = {a, b, c, d};
+	Quad ret;
+	std::memcpy(ret.v, bits, sizeof(bits));
+	return ret;
+}
+static inline Quad quad_dup2(float const *xy) { return quad(xy[0], xy[1], xy[0], xy[1]); }
+static inline Quad add(Quad a, Quad b) { return quad(a.v[0]+b.v[0], a.v[1]+b.v[1], a.v[2]+b.v[2], a.v[3]+b.v[3]); }
+static inline Quad mul(Quad a, Quad b) { return quad(a.v[0]*b.v[0], a.v[1]*b.v[1], a.v[2]*b.v[2], a.v[3]*b.v[3]); }
+static inline Quad low_low(Quad a, Quad b) { return quad(a.v[0], a.v[1], b.v[0], b.v[1]); }
+static inline Quad high_high(Quad a, Quad b) { return quad(b.v[2], b.v[3], a.v[2], a.v[3]); }
+static inline Quad swap_halves(Quad a) { return quad(a.v[2], a.v[3], a.v[0], a.v[1]); }
+static inline Quad perp(Quad a) { return quad(-a.v[1], a.v[0], -a.v[3], a.v[2]); }
+static inline void store(float *out, Quad a) { std::memcpy(out, a.v, sizeof(a.v)); }
+static inline void store_low(float *out, Quad a) { std::memcpy(out, a.v, 2 * sizeof(float)); }
+
+#endif
+
+//Per-arc constants for writing vertices:
+struct VertexTail {
+	VertexTail(glm::u8vec4 color) {
+		uint32_t color_bits, half_bits;
+		float half = 0.5f;
+		std::memcpy(&color_bits, &color, sizeof(color_bits));
+		std::memcpy(&half_bits, &half, sizeof(half_bits));
+		tail = quad_bits(0, color_bits, half_bits, half_bits);
+	}
+	Quad tail; //(0, color, 0.5, 0.5)
+};
+
+//write vertices at points (p0, p1) and (p2, p3) of 'points':
+static inline void store_pair(float *&out, Quad points, VertexTail const &t) {
+	store(out + 0, low_low(points, t.tail)); //x y 0 color
+	store(out + 4, high_high(points, t.tail)); //0.5 0.5 x y
+	store(out + 8, t.tail); //0 color 0.5 0.5
+	out += 12;
+}
+
+//write the single vertex at points (p0, p1):
+static inline void store_single(float *&out, Quad points, VertexTail const &t) {
+	store(out + 0, low_low(points, t.tail));
+	store_low(out + 4, swap_halves(t.tail));
+	out += 6;
+}
+
+//rotate a (dx, dy, dx, dy) table direction by the complex number 'rotation' = (c, s):
+static inline Quad rotate(Quad dir, Quad rotation_re, Quad rotation_im) {
+	return add(mul(dir, rotation_re), mul(perp(dir), rotation_im));
+}
+
+void emit_sector(void *dest, glm::vec2 center, glm::vec2 radius, glm::vec2 angles, ArcSteps const &steps, glm::u8vec4 color) {
+	assert((steps.segments - 1) * steps.stride < UNIT_CIRCLE_STEPS);
+
+	float *out = reinterpret_cast< float * >(dest);
+	VertexTail t(color);
+
+	//each "point" quad holds (inner.x, inner.y, outer.x, outer.y) for one direction:
+	Quad c = quad(center.x, center.y, center.x, center.y);
+	Quad r = quad(radius.x, radius.x, radius.y, radius.y);
+	float rc = cosf(angles.x), rs = sinf(angles.x);
+	Quad rot_re = quad(rc, rc, rc, rc);
+	Quad rot_im = quad(rs, rs, rs, rs);
+
+	Quad io0 = add(c, mul(rotate(quad_dup2(unit_circle.xy), rot_re, rot_im), r));
+	for (uint32_t i = 1; i <= steps.segments; ++i) {
+		Quad dir;
+		if (i < steps.segments) {
+			dir = rotate(quad_dup2(unit_circle.xy + 2 * (i * steps.stride)), rot_re, rot_im);
+		} else {
+			float ec = cosf(angles.y), es = sinf(angles.y);
+			dir = quad(ec, es, ec, es);
+		}
+		Quad io1 = add(c, mul(dir, r));
+
+		//two triangles: (inner1, inner0, outer0), (outer0, outer1, inner1):
+		store_pair(out, low_low(io1, io0), t);
+		store_pair(out, high_high(io0, io0), t);
+		store_pair(out, swap_halves(io1), t);
+
+		io0 = io1;
+	}
+}
+
+void emit_disc(void *dest, glm::vec2 center, float radius, ArcSteps const &steps, glm::u8vec4 color) {
+	assert((steps.segments - 1) * steps.stride < UNIT_CIRCLE_STEPS);
+
+	float *out = reinterpret_cast< float * >(dest);
+	VertexTail t(color);
+
+	//discs always start at angle zero, so table directions are used as-is:
+	Quad c = quad(center.x, center.y, center.x, center.y);
+	Quad r = quad(radius, radius, radius, radius);
+
+	Quad o0 = add(c, mul(quad_dup2(unit_circle.xy), r));
+	for (uint32_t i = 1; i <= steps.segments; ++i) {
+		//the last step wraps around to the first direction:
+		uint32_t index = (i < steps.segments ? i * steps.stride : 0);
+		Quad o1 = add(c, mul(quad_dup2(unit_circle.xy + 2 * index), r));
+
+		//triangle (center, outer0, outer1):
+		store_pair(out, low_low(c, o0), t);
+		store_single(out, o1, t);
+
+		o0 = o1;
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Vertex generation for annular sectors and discs.
+ *
+ * Directions come from a compile-time unit-circle table, rotated into place
+ *  with one complex multiply per vertex (no per-vertex trig), and vertices are
+ *  written straight into the destination with SSE stores where available.
+ *
+ * The destination must use BatchRenderer's 24-byte vertex layout:
+ *  vec3 Position, u8vec4 Color, vec2 TexCoord (texcoord is always (0.5, 0.5)).
+ */
+
+//Resolution of the unit-circle table; arcs step through it in power-of-two strides:
+constexpr uint32_t UNIT_CIRCLE_STEPS = 1024;
+
+//How an arc is split up: 'segments' steps of 'stride' table entries each
+// (the final step is shortened so the arc ends exactly at its end angle):
+struct ArcSteps {
+	uint32_t stride = 1;
+	uint32_t segments = 1;
+};
+
+//Largest angle (radians) one straight segment may cover on an arc of the given radius
+// (in pixels) while staying within max_error pixels of the true arc:
+float arc_max_step(float radius, float max_error);
+
+//Pick the coarsest table stride whose steps are no bigger than max_step radians:
+ArcSteps arc_steps(float span, float max_step);
+
+//Vertices written by the emitters for a given tessellation:
+inline size_t sector_vertex_count(ArcSteps const &steps) { return 6 * size_t(steps.segments); }
+inline size_t disc_vertex_count(ArcSteps const &steps) { return 3 * size_t(steps.segments); }
+
+//Annular sector between radius.x and radius.y, from angles.x to angles.y (radians), as a triangle list:
+void emit_sector(void *dest, glm::vec2 center, glm::vec2 radius, glm::vec2 angles, ArcSteps const &steps, glm::u8vec4 color);
+
+//Filled disc as a fan-ordered triangle list:
+void emit_disc(void *dest, glm::vec2 center, float radius, ArcSteps const &steps, glm::u8vec4 color);
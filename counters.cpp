@@ -0,0 +1,38 @@
+#include "counters.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+CounterRegistry counters;
+
+Counter &CounterRegistry::add(char const *name, Counter::Kind kind) {
+	uint32_t index = count.fetch_add(1, std::memory_order_relaxed);
+	if (index >= MaxCounters) {
+		//(stdio rather than iostream, since this may run during static initialization)
+		if (index == MaxCounters) {
+			std::fprintf(stderr, "More than %u counters registered; '%s' and later ones won't be shown.\n", unsigned(MaxCounters), name);
+		}
+		return overflow;
+	}
+	Counter &counter = counters[index];
+	counter.name = name;
+	counter.kind = kind;
+	counter.ready.store(true, std::memory_order_release);
+	return counter;
+}
+
+uint32_t CounterRegistry::size() const {
+	return std::min< uint32_t >(count.load(std::memory_order_acquire), MaxCounters);
+}
+
+void CounterRegistry::begin_frame() {
+	for (uint32_t i = 0; i < size(); ++i) {
+		Counter &counter = counters[i];
+		if (!counter.ready.load(std::memory_order_acquire)) continue;
+		if (counter.kind == Counter::PerFrame) {
+			counter.last_frame = counter.value.exchange(0, std::memory_order_relaxed);
+		} else {
+			counter.last_frame = counter.value.load(std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+/*
+ * Named counters that any subsystem (on any thread) can publish, shown by the debug HUD.
+ *
+ * Register once, e.g. at file scope, then add to or set the counter as often as needed:
+ *
+ *   static Counter &draw_calls = counters.add("draw calls");
+ *   ...
+ *   draw_calls.add(1);
+ *
+ * Registration and updates never lock. The main loop calls counters.begin_frame()
+ *  once per frame, which copies each value into 'last_frame' (and zeroes
+ *  PerFrame counters).
+ */
+
+struct Counter {
+	enum Kind : uint8_t {
+		PerFrame, //summed over a frame, then reset
+		Gauge, //keeps its value until set again
+	};
+
+	void add(uint64_t amount) { value.fetch_add(amount, std::memory_order_relaxed); }
+	void set(uint64_t amount) { value.store(amount, std::memory_order_relaxed); }
+
+	char const *name = nullptr;
+	Kind kind = PerFrame;
+	std::atomic< uint64_t > value{0};
+	uint64_t last_frame = 0; //the value at the end of the previous frame (main thread only)
+	std::atomic< bool > ready{false}; //set once 'name' and 'kind' are filled in
+};
+
+struct CounterRegistry {
+	//'name' must outlive the registry (use string literals):
+	Counter &add(char const *name, Counter::Kind kind = Counter::PerFrame);
+
+	//called by the main loop once per frame:
+	void begin_frame();
+
+	enum : uint32_t { MaxCounters = 64 };
+
+	//registered counters are [0, size()), but check 'ready' before reading a name:
+	uint32_t size() const;
+	Counter const &operator[](uint32_t i) const { return counters[i]; }
+
+private:
+	Counter counters[MaxCounters];
+	std::atomic< uint32_t > count{0};
+	Counter overflow; //handed out (and never shown, with a one-time warning) once counters[] is full
+};
+
+//(constant-initialized, so file-scope counters in other translation units may register with it)
+extern CounterRegistry counters;
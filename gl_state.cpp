@@ -0,0 +1,148 @@
+#include "gl_state.hpp"
+
+//for the debug HUD:
+#include "counters.hpp"
+
+GLStateCache gl_state;
+
+static Counter &gl_calls_issued = counters.add("gl state calls");
+static Counter &gl_calls_skipped = counters.add("gl state skipped");
+
+//marks a cached value as unknown, so the next call always goes through:
+static constexpr GLuint Unknown = ~GLuint(0);
+
+GLStateCache::GLStateCache() {
+	invalidate();
+}
+
+void GLStateCache::begin_frame() {
+	last_frame = counts;
+	counts = Counts();
+	gl_calls_issued.add(last_frame.issued);
+	gl_calls_skipped.add(last_frame.skipped);
+}
+
+bool GLStateCache::cached(GLuint &slot, GLuint value) {
+	if (slot == value) {
+		counts.skipped += 1;
+		return true;
+	}
+	slot = value;
+	counts.issued += 1;
+	return false;
+}
+
+void GLStateCache::use_program(GLuint program_) {
+	if (cached(program, program_)) return;
+	glUseProgram(program_);
+}
+
+void GLStateCache::bind_vertex_array(GLuint vertex_array_) {
+	if (cached(vertex_array, vertex_array_)) return;
+	glBindVertexArray(vertex_array_);
+}
+
+void GLStateCache::bind_buffer(GLenum target, GLuint buffer) {
+	GLuint *slot = nullptr;
+	if (target == GL_ARRAY_BUFFER) slot = &array_buffer;
+	else if (target == GL_PIXEL_PACK_BUFFER) slot = &pixel_pack_buffer;
+	else if (target == GL_PIXEL_UNPACK_BUFFER) slot = &pixel_unpack_buffer;
+
+	if (slot) {
+		if (cached(*slot, buffer)) return;
+	} else {
+		counts.issued += 1;
+	}
+	glBindBuffer(target, buffer);
+}
+
+void GLStateCache::active_texture(GLenum unit) {
+	if (cached(texture_unit, unit - GL_TEXTURE0)) return;
+	glActiveTexture(unit);
+}
+
+void GLStateCache::bind_texture(GLenum target, GLuint texture) {
+	if (target == GL_TEXTURE_2D && texture_unit < MaxTextureUnits) {
+		if (cached(texture_2d[texture_unit], texture)) return;
+	} else {
+		//(an unknown unit or other target can't be tracked)
+		counts.issued += 1;
+	}
+	glBindTexture(target, texture);
+}
+
+void GLStateCache::enable(GLenum cap) {
+	GLuint *slot = nullptr;
+	if (cap == GL_BLEND) slot = &blend;
+	else if (cap == GL_DEPTH_TEST) slot = &depth_test;
+	else if (cap == GL_CULL_FACE) slot = &cull_face;
+	else if (cap == GL_SCISSOR_TEST) slot = &scissor_test;
+
+	if (slot) {
+		if (cached(*slot, 1)) return;
+	} else {
+		counts.issued += 1;
+	}
+	glEnable(cap);
+}
+
+void GLStateCache::disable(GLenum cap) {
+	GLuint *slot = nullptr;
+	if (cap == GL_BLEND) slot = &blend;
+	else if (cap == GL_DEPTH_TEST) slot = &depth_test;
+	else if (cap == GL_CULL_FACE) slot = &cull_face;
+	else if (cap == GL_SCISSOR_TEST) slot = &scissor_test;
+
+	if (slot) {
+		if (cached(*slot, 0)) return;
+	} else {
+		counts.issued += 1;
+	}
+	glDisable(cap);
+}
+
+void GLStateCache::blend_func(GLenum sfactor, GLenum dfactor) {
+	if (blend_sfactor == sfactor && blend_dfactor == dfactor) {
+		counts.skipped += 1;
+		return;
+	}
+	blend_sfactor = sfactor;
+	blend_dfactor = dfactor;
+	counts.issued += 1;
+	glBlendFunc(sfactor, dfactor);
+}
+
+void GLStateCache::deleted_program(GLuint program_) {
+	//(a deleted program stays in use until another is bound, but its name may be reused)
+	if (program == program_) program = Unknown;
+}
+
+void GLStateCache::deleted_vertex_array(GLuint vertex_array_) {
+	if (vertex_array == vertex_array_) vertex_array = 0;
+}
+
+void GLStateCache::deleted_buffer(GLuint buffer) {
+	if (array_buffer == buffer) array_buffer = 0;
+	if (pixel_pack_buffer == buffer) pixel_pack_buffer = 0;
+	if (pixel_unpack_buffer == buffer) pixel_unpack_buffer = 0;
+}
+
+void GLStateCache::deleted_texture(GLuint texture) {
+	for (GLuint &t : texture_2d) {
+		if (t == texture) t = 0;
+	}
+}
+
+void GLStateCache::invalidate() {
+	program = Unknown;
+	vertex_array = Unknown;
+	array_buffer = Unknown;
+	pixel_pack_buffer = Unknown;
+	pixel_unpack_buffer = Unknown;
+	texture_unit = Unknown;
+	for (GLuint &t : texture_2d) {
+		t = Unknown;
+	}
+	blend = depth_test = cull_face = scissor_test = Unknown;
+	blend_sfactor = blend_dfactor = Unknown;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <stdint.h>
+
+/*
+ * Thin state-tracking layer over the GL.hpp binding calls.
+ * Calls that would re-set the state GL already has are skipped (and counted).
+ *
+ * All binding in the codebase should go through gl_state. Code that changes
+ *  tracked state behind its back must call gl_state.invalidate() afterward,
+ *  and deleting a GL object should be reported with the matching deleted_*().
+ */
+
+struct GLStateCache {
+	GLStateCache();
+
+	void use_program(GLuint program);
+	void bind_vertex_array(GLuint vertex_array);
+	void bind_buffer(GLenum target, GLuint buffer); //caches GL_ARRAY_BUFFER and GL_PIXEL_{PACK,UNPACK}_BUFFER
+	void active_texture(GLenum unit);
+	void bind_texture(GLenum target, GLuint texture); //caches GL_TEXTURE_2D on the first MaxTextureUnits units
+	void enable(GLenum cap); //caches GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST
+	void disable(GLenum cap);
+	void blend_func(GLenum sfactor, GLenum dfactor);
+
+	//deleting a bound object resets that binding to zero; tell the cache:
+	void deleted_program(GLuint program);
+	void deleted_vertex_array(GLuint vertex_array);
+	void deleted_buffer(GLuint buffer);
+	void deleted_texture(GLuint texture);
+
+	//forget everything; the next call of each kind will always reach GL:
+	void invalidate();
+
+	//GL calls made ("issued") and avoided ("skipped"):
+	struct Counts {
+		uint32_t issued = 0;
+		uint32_t skipped = 0;
+	};
+	Counts counts; //since the start of the current frame
+	Counts last_frame; //for the whole previous frame
+
+	//called by the main loop once per frame (also publishes last frame's counts to the debug HUD):
+	void begin_frame();
+
+	enum : uint32_t { MaxTextureUnits = 8 };
+
+private:
+	//returns true (and counts a skip) if 'value' is already cached in 'slot':
+	bool cached(GLuint &slot, GLuint value);
+
+	GLuint program;
+	GLuint vertex_array;
+	GLuint array_buffer;
+	GLuint pixel_pack_buffer;
+	GLuint pixel_unpack_buffer;
+	GLuint texture_unit; //index, not GL_TEXTUREi
+	GLuint texture_2d[MaxTextureUnits];
+	GLuint blend, depth_test, cull_face, scissor_test; //0 = disabled, 1 = enabled
+	GLuint blend_sfactor, blend_dfactor;
+};
+
+//The cache for the (single) GL context:
+extern GLStateCache gl_state;
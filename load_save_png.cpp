@@ -1,91 +1,135 @@
 #include "load_save_png.hpp"
 
+#include "alloc_tracking.hpp"
+#include "JobSystem.hpp"
+#include "MappedFile.hpp"
+#include "trace_zones.hpp"
+
 #include <png.h>
+#include <zlib.h>
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 
 #define LOG_ERROR( X ) std::cerr << X << std::endl
 
 using std::vector;
 
-bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vector< glm::u8vec4 > *data, OriginLocation origin);
-void save_png(std::ostream &to, unsigned int width, unsigned int height, glm::u8vec4 const *data, OriginLocation origin);
+template< typename GetDest >
+static bool load_png(uint8_t const *bytes, size_t length, glm::uvec2 *size, GetDest const &get_dest, OriginLocation origin);
+void save_png(std::ostream &to, unsigned int width, unsigned int height, glm::u8vec4 const *data, OriginLocation origin, PNGEncoding const &encoding);
 
 void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin) {
+	ALLOC_TAG(AllocPNG);
 	assert(size);
 
-	std::ifstream file(filename.c_str(), std::ios::binary);
-	if (!file) {
-		throw std::runtime_error("Failed to open PNG image file '" + filename + "'.");
-	}
-	if (!load_png(file, &size->x, &size->y, data, origin)) {
+	assert(data);
+	data->clear();
+
+	MappedFile file(filename);
+	auto get_dest = [data](glm::uvec2 const &image_size) {
+		data->resize(size_t(image_size.x) * image_size.y);
+		return data->data();
+	};
+	if (!load_png(file.data, file.size, size, get_dest, origin)) {
+		data->clear();
 		throw std::runtime_error("Failed to read PNG image from '" + filename + "'.");
 	}
 }
 
-void save_png(std::string filename, glm::uvec2 size, glm::u8vec4 const *data, OriginLocation origin) {
-	std::ofstream file(filename.c_str(), std::ios::binary);
-	save_png(file, size.x, size.y, data, origin);
+glm::uvec2 load_png_size(std::string filename) {
+	MappedFile file(filename);
+	//signature, then the IHDR chunk (which must come first): length, type, width, height:
+	static uint8_t const signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	uint8_t const *b = file.data;
+	if (file.size < 24 || std::memcmp(b, signature, 8) != 0 || std::memcmp(b + 12, "IHDR", 4) != 0) {
+		throw std::runtime_error("Failed to read PNG header from '" + filename + "'.");
+	}
+	auto be32 = [](uint8_t const *at) {
+		return (uint32_t(at[0]) << 24) | (uint32_t(at[1]) << 16) | (uint32_t(at[2]) << 8) | uint32_t(at[3]);
+	};
+	return glm::uvec2(be32(b + 16), be32(b + 20));
 }
 
+void load_png_into(std::string filename, glm::uvec2 size, glm::u8vec4 *dest, OriginLocation origin) {
+	assert(dest);
 
-static void user_read_data(png_structp png_ptr, png_bytep data, png_size_t length) {
-	std::istream *from = reinterpret_cast< std::istream * >(png_get_io_ptr(png_ptr));
-	assert(from);
-	if (!from->read(reinterpret_cast< char * >(data), length)) {
-		png_error(png_ptr, "Error reading.");
+	MappedFile file(filename);
+	bool size_matches = true;
+	auto get_dest = [&](glm::uvec2 const &image_size) -> glm::u8vec4 * {
+		size_matches = (image_size.x == size.x && image_size.y == size.y);
+		return (size_matches ? dest : nullptr);
+	};
+	glm::uvec2 image_size;
+	if (!load_png(file.data, file.size, &image_size, get_dest, origin)) {
+		if (!size_matches) {
+			throw std::runtime_error("PNG image '" + filename + "' is " + std::to_string(image_size.x) + "x" + std::to_string(image_size.y)
+				+ ", not the expected " + std::to_string(size.x) + "x" + std::to_string(size.y) + ".");
+		}
+		throw std::runtime_error("Failed to read PNG image from '" + filename + "'.");
 	}
 }
 
-static void user_write_data(png_structp png_ptr, png_bytep data, png_size_t length) {
-	std::ostream *to = reinterpret_cast< std::ostream * >(png_get_io_ptr(png_ptr));
-	assert(to);
-	if (!to->write(reinterpret_cast< char * >(data), length)) {
-		png_error(png_ptr, "Error writing.");
+void save_png(std::string filename, glm::uvec2 size, glm::u8vec4 const *data, OriginLocation origin, PNGEncoding const &encoding) {
+	ALLOC_TAG(AllocPNG);
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	if (!file) {
+		LOG_ERROR("Failed to open '" << filename << "' for writing.");
+		return;
+	}
+	save_png(file, size.x, size.y, data, origin, encoding);
+	if (!file) {
+		LOG_ERROR("Error writing png to '" << filename << "'.");
 	}
 }
 
-static void user_flush_data(png_structp png_ptr) {
-	std::ostream *to = reinterpret_cast< std::ostream * >(png_get_io_ptr(png_ptr));
-	assert(to);
-	if (!to->flush()) {
-		png_error(png_ptr, "Error flushing.");
+
+//libpng reads straight out of the (mapped) file:
+struct MemoryReader {
+	uint8_t const *at;
+	uint8_t const *end;
+};
+
+static void user_read_data(png_structp png_ptr, png_bytep data, png_size_t length) {
+	MemoryReader *from = reinterpret_cast< MemoryReader * >(png_get_io_ptr(png_ptr));
+	assert(from);
+	if (size_t(from->end - from->at) < length) {
+		png_error(png_ptr, "Error reading (file is truncated).");
 	}
+	std::memcpy(data, from->at, length);
+	from->at += length;
 }
 
 
-bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vector< glm::u8vec4 > *data, OriginLocation origin) {
-	assert(data);
-	uint32_t local_width, local_height;
-	if (width == nullptr) width = &local_width;
-	if (height == nullptr) height = &local_height;
-	*width = *height = 0;
-	data->clear();
+
+template< typename GetDest >
+static bool load_png(uint8_t const *bytes, size_t length, glm::uvec2 *size, GetDest const &get_dest, OriginLocation origin) {
+	assert(size);
+	*size = glm::uvec2(0);
+	MemoryReader from{ bytes, bytes + length };
 	//..... load file ......
 	//Load a png file, as per the libpng docs:
 	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, (png_error_ptr)NULL, (png_error_ptr)NULL);
-
-	png_set_read_fn(png, &from, user_read_data);
-
 	if (!png) {
 		LOG_ERROR("  cannot alloc read struct.");
 		return false;
 	}
+	png_set_read_fn(png, &from, user_read_data);
+
 	png_infop info = png_create_info_struct(png);
 	if (!info) {
 		LOG_ERROR("  cannot alloc info struct.");
 		png_destroy_read_struct(&png, (png_infopp)NULL, (png_infopp)NULL);
 		return false;
 	}
-	png_bytep *row_pointers = NULL;
 	if (setjmp(png_jmpbuf(png))) {
 		LOG_ERROR("  png interal error.");
 		png_destroy_read_struct(&png, &info, (png_infopp)NULL);
-		if (row_pointers != NULL) delete[] row_pointers;
-		data->clear();
 		return false;
 	}
 	//not needed with custom read/write functions: png_init_io(png, NULL);
@@ -102,74 +146,206 @@ bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vec
 		png_set_packing(png);
 	if (png_get_bit_depth(png,info) == 16)
 		png_set_strip_16(png);
+	//(interlaced images are read in several passes over the same rows)
+	int passes = png_set_interlace_handling(png);
 	//Ok, should be 32-bit RGBA now.
 
 	png_read_update_info(png, info);
 	size_t rowbytes = png_get_rowbytes(png, info);
 	//Make sure it's the format we think it is...
 	assert(rowbytes == w*sizeof(uint32_t));
+	(void)rowbytes;
+
+	*size = glm::uvec2(w, h);
+	glm::u8vec4 *dest = get_dest(*size);
+	if (!dest) {
+		png_destroy_read_struct(&png, &info, NULL);
+		return false;
+	}
 
-	data->resize(w*h);
-	row_pointers = new png_bytep[h];
-	for (unsigned int r = 0; r < h; ++r) {
-		if (origin == LowerLeftOrigin) {
-			row_pointers[h-1-r] = (png_bytep)(&(*data)[r*w]);
-		} else {
-			row_pointers[r] = (png_bytep)(&(*data)[r*w]);
+	//rows go straight to their place in 'dest' (no row pointer array, no intermediate copy):
+	for (int pass = 0; pass < passes; ++pass) {
+		for (unsigned int r = 0; r < h; ++r) {
+			png_read_row(png, (png_bytep)(dest + size_t(origin == LowerLeftOrigin ? h-1-r : r) * w), NULL);
 		}
 	}
-	png_read_image(png, row_pointers);
 	png_destroy_read_struct(&png, &info, NULL);
-	delete[] row_pointers;
-
-	*width = w;
-	*height = h;
 	return true;
 }
 
 
-void save_png(std::ostream &to, unsigned int width, unsigned int height, glm::u8vec4 const *data, OriginLocation origin) {
-//After the libpng example.c
-	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+//---- parallel encoder ----
 
-	png_set_write_fn(png_ptr, &to, user_write_data, user_flush_data);
+//PNG's per-row prediction, for 4-byte pixels ('above' is all zeros for the first row):
+static uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+	int p = int(a) + int(b) - int(c);
+	int pa = std::abs(p - int(a)), pb = std::abs(p - int(b)), pc = std::abs(p - int(c));
+	if (pa <= pb && pa <= pc) return a;
+	if (pb <= pc) return b;
+	return c;
+}
 
-	if (png_ptr == NULL) {
-		LOG_ERROR("Can't create write struct.");
-		return;
+static inline uint8_t filter_byte(uint8_t type, uint8_t const *row, uint8_t const *above, size_t i) {
+	uint8_t left = (i >= 4 ? row[i - 4] : 0);
+	uint8_t predicted = 0;
+	if (type == PNGEncoding::FilterSub) predicted = left;
+	else if (type == PNGEncoding::FilterUp) predicted = above[i];
+	else if (type == PNGEncoding::FilterAverage) predicted = uint8_t((int(left) + int(above[i])) / 2);
+	else if (type == PNGEncoding::FilterPaeth) predicted = paeth(left, above[i], (i >= 4 ? above[i - 4] : 0));
+	return uint8_t(row[i] - predicted);
+}
+
+static void filter_row(uint8_t type, uint8_t const *row, uint8_t const *above, size_t bytes, uint8_t *out) {
+	out[0] = type;
+	for (size_t i = 0; i < bytes; ++i) {
+		out[1 + i] = filter_byte(type, row, above, i);
 	}
+}
 
-	png_infop info_ptr = png_create_info_struct(png_ptr);
-	if (info_ptr == NULL) {
-		png_destroy_write_struct(&png_ptr, NULL);
-		LOG_ERROR("Can't craete info pointer");
-		return;
+//the usual heuristic: treat the filtered bytes as signed; smaller magnitudes compress better:
+static uint64_t filter_cost(uint8_t type, uint8_t const *row, uint8_t const *above, size_t bytes) {
+	uint64_t cost = 0;
+	for (size_t i = 0; i < bytes; ++i) {
+		cost += uint64_t(std::abs(int(int8_t(filter_byte(type, row, above, i)))));
 	}
+	return cost;
+}
 
-	if (setjmp(png_jmpbuf(png_ptr))) {
-		png_destroy_write_struct(&png_ptr, &info_ptr);
-		LOG_ERROR("Error writing png.");
-		return;
+static void write_u32(std::ostream &to, uint32_t val) {
+	unsigned char bytes[4] = { uint8_t(val >> 24), uint8_t(val >> 16), uint8_t(val >> 8), uint8_t(val) };
+	to.write(reinterpret_cast< char const * >(bytes), 4);
+}
+
+static void write_chunk(std::ostream &to, char const type[4], unsigned char const *data, size_t length) {
+	write_u32(to, uint32_t(length));
+	to.write(type, 4);
+	if (length) to.write(reinterpret_cast< char const * >(data), length);
+	uLong crc = crc32(0, reinterpret_cast< Bytef const * >(type), 4);
+	if (length) crc = crc32(crc, data, uInt(length));
+	write_u32(to, uint32_t(crc));
+}
+
+void save_png(std::ostream &to, unsigned int width, unsigned int height, glm::u8vec4 const *data, OriginLocation origin, PNGEncoding const &encoding) {
+	//rows of the image in file order (top to bottom):
+	size_t row_bytes = size_t(width) * 4;
+	auto row = [&](uint32_t y) -> uint8_t const * {
+		uint32_t src = (origin == UpperLeftOrigin ? y : height - 1 - y);
+		return reinterpret_cast< uint8_t const * >(data + size_t(src) * width);
+	};
+
+	//filter every row (each row depends only on the unfiltered row above it, so any order works):
+	size_t line_bytes = 1 + row_bytes;
+	std::vector< uint8_t > filtered(line_bytes * height);
+	std::vector< uint8_t > zeros(row_bytes, 0);
+	{
+		TRACE_ZONE("png filter");
+		auto filter = [&](uint32_t y) {
+			uint8_t const *above = (y > 0 ? row(y - 1) : zeros.data());
+			uint8_t type = encoding.filter;
+			if (type == PNGEncoding::FilterAdaptive) {
+				uint64_t best = ~uint64_t(0);
+				for (uint8_t candidate = PNGEncoding::FilterNone; candidate < PNGEncoding::FilterAdaptive; ++candidate) {
+					uint64_t cost = filter_cost(candidate, row(y), above, row_bytes);
+					if (cost < best) {
+						best = cost;
+						type = candidate;
+					}
+				}
+			}
+			filter_row(type, row(y), above, row_bytes, &filtered[line_bytes * y]);
+		};
+		if (jobs) jobs->parallel_for(height, filter, 16);
+		else for (uint32_t y = 0; y < height; ++y) filter(y);
 	}
 
-	//Not needed with custom read/write functions: png_init_io(png_ptr, fp);
-	png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+	//deflate bands of rows independently; each is primed with the (up to) 32k before it, so
+	// matches still reach back across band boundaries, and ends with a sync flush (all but the
+	// last), which ends it on a byte boundary so the next band's stream can follow directly:
+	enum : size_t { BandBytes = 128 * 1024, Window = 32 * 1024 };
+	uint32_t band_rows = uint32_t(std::max< size_t >(1, BandBytes / line_bytes));
+	uint32_t band_count = (height + band_rows - 1) / band_rows;
+	struct Band {
+		size_t begin = 0, end = 0; //in 'filtered'
+		std::vector< uint8_t > deflated; //(the first band also holds the zlib header)
+		size_t length = 0;
+		uLong adler = 1;
+		bool ok = false;
+	};
+	std::vector< Band > bands(band_count);
+	int level = std::min(9, std::max(0, encoding.level));
+	{
+		TRACE_ZONE("png deflate");
+		auto compress = [&](uint32_t b) {
+			Band &band = bands[b];
+			size_t begin = band.begin = line_bytes * size_t(b) * band_rows;
+			size_t end = band.end = std::min(filtered.size(), line_bytes * size_t(b + 1) * band_rows);
+			bool last = (b + 1 == band_count);
+			size_t header = (b == 0 ? 2 : 0);
 
-	png_write_info(png_ptr, info_ptr);
-	//png_set_swap_alpha(png_ptr) // might need?
-	vector< png_bytep > row_pointers(height);
-	for (unsigned int i = 0; i < height; ++i) {
-		if (origin == UpperLeftOrigin) {
-			row_pointers[i] = (png_bytep)&(data[i * width]);
-		} else {
-			row_pointers[i] = (png_bytep)&(data[(height - 1 - i) * width]);
+			z_stream z;
+			z.zalloc = Z_NULL;
+			z.zfree = Z_NULL;
+			z.opaque = Z_NULL;
+			//(raw deflate: the zlib header and checksum are written once, around all the bands)
+			if (deflateInit2(&z, level, Z_DEFLATED, -15, 8, encoding.filter == PNGEncoding::FilterNone ? Z_DEFAULT_STRATEGY : Z_FILTERED) != Z_OK) return;
+			if (begin > 0) {
+				size_t dictionary = std::min< size_t >(Window, begin);
+				deflateSetDictionary(&z, &filtered[begin - dictionary], uInt(dictionary));
+			}
+			band.deflated.resize(header + deflateBound(&z, uLong(end - begin)) + 16); //(+ room for the sync flush marker)
+			if (header) {
+				//zlib header: deflate with a 32k window, FLEVEL from the level, and check bits:
+				band.deflated[0] = 0x78;
+				band.deflated[1] = uint8_t((level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6);
+				band.deflated[1] += uint8_t((31 - (0x78 * 256 + band.deflated[1]) % 31) % 31);
+			}
+			z.next_in = &filtered[begin];
+			z.avail_in = uInt(end - begin);
+			z.next_out = band.deflated.data() + header;
+			z.avail_out = uInt(band.deflated.size() - header);
+			int result = deflate(&z, last ? Z_FINISH : Z_SYNC_FLUSH);
+			band.ok = (last ? result == Z_STREAM_END : result == Z_OK) && z.avail_in == 0;
+			band.length = band.deflated.size() - z.avail_out;
+			deflateEnd(&z);
+
+			band.adler = adler32(1, &filtered[begin], uInt(end - begin));
+		};
+		if (jobs) jobs->parallel_for(band_count, compress);
+		else for (uint32_t b = 0; b < band_count; ++b) compress(b);
+	}
+
+	//stitch the bands into a zlib stream (one IDAT chunk per band), with the checksum of the whole at the end:
+	uLong adler = 1;
+	for (auto const &band : bands) {
+		if (!band.ok) {
+			LOG_ERROR("Error deflating png data.");
+			to.setstate(std::ios::failbit);
+			return;
 		}
+		adler = adler32_combine(adler, band.adler, z_off_t(band.end - band.begin));
 	}
-	png_write_image(png_ptr, &(row_pointers[0]));
+	if (!bands.empty()) {
+		Band &last = bands.back();
+		last.deflated.resize(last.length);
+		for (uint32_t shift : { 24, 16, 8, 0 }) last.deflated.push_back(uint8_t(adler >> shift));
+		last.length += 4;
+	}
+
+	static unsigned char const signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	to.write(reinterpret_cast< char const * >(signature), 8);
 
-	png_write_end(png_ptr, info_ptr);
+	unsigned char ihdr[13] = {
+		uint8_t(width >> 24), uint8_t(width >> 16), uint8_t(width >> 8), uint8_t(width),
+		uint8_t(height >> 24), uint8_t(height >> 16), uint8_t(height >> 8), uint8_t(height),
+		8, //bit depth
+		6, //color type: RGBA
+		0, 0, 0 //compression, filter, interlace methods
+	};
+	write_chunk(to, "IHDR", ihdr, sizeof(ihdr));
 
-	png_destroy_write_struct(&png_ptr, &info_ptr);
+	for (auto const &band : bands) {
+		write_chunk(to, "IDAT", band.deflated.data(), band.length);
+	}
 
-	return;
+	write_chunk(to, "IEND", nullptr, 0);
 }
@@ -15,6 +15,36 @@ enum OriginLocation {
 	UpperLeftOrigin,
 };
 
-//NOTE: load_png will throw on error
+//How save_png compresses: rows are filtered (PNG's per-row prediction), then
+// deflated at zlib 'level' (0 = stored ... 9 = smallest):
+struct PNGEncoding {
+	enum Filter : uint8_t { //(values are PNG's filter types)
+		FilterNone,
+		FilterSub,
+		FilterUp,
+		FilterAverage,
+		FilterPaeth,
+		FilterAdaptive, //per row, whichever of the above looks smallest (what libpng does by default)
+	};
+	int level;
+	Filter filter;
+};
+static PNGEncoding const PNGDefault = { 6, PNGEncoding::FilterAdaptive }; //about what libpng would write
+static PNGEncoding const PNGFastCapture = { 1, PNGEncoding::FilterUp }; //for recording frames; much faster, somewhat larger
+static PNGEncoding const PNGSmallest = { 9, PNGEncoding::FilterAdaptive };
+
+//PNGs are decoded straight out of a memory-mapped file.
+//NOTE: load_png, load_png_size, and load_png_into will throw on error
 void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin);
-void save_png(std::string filename, glm::uvec2 size, glm::u8vec4 const *data, OriginLocation origin);
+
+//decode into caller-provided memory (e.g., a mapped pixel unpack buffer), which must hold
+// size.x * size.y pixels; 'size' must match the file's (load_png_size reads just the header):
+glm::uvec2 load_png_size(std::string filename);
+void load_png_into(std::string filename, glm::uvec2 size, glm::u8vec4 *dest, OriginLocation origin);
+
+//save_png splits the image into bands of rows that are filtered and deflated
+// in parallel on the JobSystem (if there is one), pigz-style: each band is
+// its own deflate stream, primed with the 32k of data before it and ended
+// on a byte boundary, so they concatenate into one zlib stream.
+//NOTE: save_png prints (but does not throw) errors
+void save_png(std::string filename, glm::uvec2 size, glm::u8vec4 const *data, OriginLocation origin, PNGEncoding const &encoding = PNGDefault);
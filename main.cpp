@@ -7,8 +7,51 @@
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
 
-//for screenshots:
-#include "load_save_png.hpp"
+//for screenshots and recording:
+#include "FrameCapture.hpp"
+
+//for per-frame scratch memory:
+#include "FrameArena.hpp"
+
+//the renderer shared by all modes:
+#include "BatchRenderer.hpp"
+
+//the job system shared by everything:
+#include "JobSystem.hpp"
+
+//for per-frame GL call counts:
+#include "gl_state.hpp"
+
+//for per-pass GPU timings:
+#include "GPUProfiler.hpp"
+
+//for CPU timing zones:
+#include "trace_zones.hpp"
+
+//for the counters overlay:
+#include "counters.hpp"
+#include "DebugHUD.hpp"
+
+//for frame time percentiles:
+#include "FrameMetrics.hpp"
+
+//for hardware performance counters:
+#include "perf_counters.hpp"
+
+//for per-subsystem allocation counts (if enabled):
+#include "alloc_tracking.hpp"
+
+//for input-to-photon latency:
+#include "LatencyProbe.hpp"
+
+//for limiting how far the CPU runs ahead of the GPU:
+#include "FramePacer.hpp"
+
+//for modes that simulate on their own thread:
+#include "SimThread.hpp"
+
+//for mouse motion read off the device, between event polls:
+#include "RawMouse.hpp"
 
 //Includes for libSDL:
 #include <SDL.h>
@@ -19,6 +62,12 @@
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
+#include <cassert>
+
+static Counter &motion_events_merged = counters.add("motion events merged");
+
+static PerfZoneStats update_perf("update");
+static PerfZoneStats draw_perf("draw");
 
 int main(int argc, char **argv) {
 #ifdef _WIN32
@@ -28,6 +77,18 @@ int main(int argc, char **argv) {
 
 	//------------  initialization ------------
 
+	trace_thread_name("main");
+
+	//worker threads shared by the renderer, modes, and frame capture:
+	std::unique_ptr< JobSystem > job_system(new JobSystem(7));
+
+	//'--bench-jobs' measures scheduling overhead and exits:
+	if (argc > 1 && std::string(argv[1]) == "--bench-jobs") {
+		job_system->benchmark(std::cout);
+		return 0;
+	}
+	jobs = job_system.get();
+
 	//Initialize SDL library:
 	SDL_Init(SDL_INIT_VIDEO);
 
@@ -86,64 +147,306 @@ int main(int argc, char **argv) {
 	//Hide mouse cursor (note: showing can be useful for debugging):
 	//SDL_ShowCursor(SDL_DISABLE);
 
+	//------------ create shared renderer --------------
+	//(owns the GL objects modes draw with, so they survive mode switches)
+	std::unique_ptr< BatchRenderer > renderer(new BatchRenderer());
+	batch_renderer = renderer.get();
+
+	//GPU pass timings (F3 toggles the overlay):
+	std::unique_ptr< GPUProfiler > profiler(new GPUProfiler());
+	gpu_profiler = profiler.get();
+
+	//mouse motion to GPU-finished latency (F6 toggles measurement, and prints results when turned off):
+	std::unique_ptr< LatencyProbe > latency(new LatencyProbe());
+
+	//render-ahead limit and input timing (F7 switches between lowest latency and max throughput, F8 cycles frames ahead):
+	std::unique_ptr< FramePacer > pacer(new FramePacer());
+
+	//PNG screenshots (PrintScreen) and recording (F10: PNG sequence, F11: Y4M; hold shift to slow down rather than drop frames),
+	// read back and encoded without stalling the frame:
+	std::unique_ptr< FrameCapture > capture(new FrameCapture());
+	bool screenshot_requested = false;
+
+	//unaccelerated mouse motion, read on its own thread where possible (F9 toggles):
+	std::unique_ptr< RawMouse > raw(new RawMouse());
+	raw_mouse = raw.get();
+
 	//------------ create game mode + make current --------------
 	Mode::set_current(std::make_shared< MyMode >());
 
 	//------------ main loop ------------
 
+	//CPU timing zones go to trace.json on exit and when F2 is pressed:
+	auto write_trace = [](){
+		#ifdef ENABLE_TRACE_ZONES
+		std::string filename = "trace.json";
+		std::cout << "Saving trace to '" << filename << "'." << std::endl;
+		if (!trace_write(filename)) {
+			std::cerr << "Error writing trace to '" << filename << "'." << std::endl;
+		}
+		#endif
+	};
+
+	//per-frame phase timings go to a crash-surviving file; percentiles are printed on exit and when F4 is pressed:
+	std::unique_ptr< FrameMetrics > metrics(new FrameMetrics("frame_metrics.bin"));
+	auto session_start = std::chrono::steady_clock::now();
+	uint64_t frame_number = 0;
+	auto ns_between = [](std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+		return uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(b - a).count());
+	};
+	//(frame records keep 32-bit durations; a stall past ~4.29s pins at the max rather than wrapping)
+	auto ns_saturated = [](uint64_t ns) {
+		return uint32_t(std::min< uint64_t >(ns, UINT32_MAX));
+	};
+
+	//cycles / instructions / cache and branch misses around update and draw (Linux, if permitted):
+	perf_counters_open();
+
 	//this inline function will be called whenever the window is resized,
 	// and will update the window_size and drawable_size variables:
 	glm::uvec2 window_size; //size of window (layout pixels)
 	glm::uvec2 drawable_size; //size of drawable (physical pixels)
 	//On non-highDPI displays, window_size will always equal drawable_size.
+	#ifndef NDEBUG
+	//frames drawn since the last resize or mode switch; once warmed up, frames shouldn't allocate:
+	uint32_t steady_frames = 0;
+	Mode const *steady_mode = nullptr;
+	#endif
+	//a frame that must be drawn even if the scene hasn't changed (after resizing, exposure, ...):
+	bool needs_redraw = true;
 	auto on_resize = [&](){
+		needs_redraw = true;
 		int w,h;
 		SDL_GetWindowSize(window, &w, &h);
 		window_size = glm::uvec2(w, h);
 		SDL_GL_GetDrawableSize(window, &w, &h);
 		drawable_size = glm::uvec2(w, h);
 		glViewport(0, 0, drawable_size.x, drawable_size.y);
+		#ifndef NDEBUG
+		steady_frames = 0;
+		#endif
 	};
 	on_resize();
 
+	//while the window is hidden or unfocused, or the scene isn't changing, the loop
+	// sleeps on the event queue and updates (and, if visible, draws) at a reduced rate:
+	bool window_visible = true; //not hidden or minimized
+	bool window_focused = true;
+	const std::chrono::milliseconds idle_frame_time(100);
+	auto next_idle_frame = std::chrono::steady_clock::now();
+
+	//modes with a simulation rate handle events and update on this thread while they are current:
+	std::unique_ptr< SimThread > sim;
+
+	//set once a pass through the loop draws and swaps; the next pass then starts a new frame's bookkeeping:
+	bool frame_produced = true;
+
 	//This will loop until the current mode is set to null:
 	while (Mode::current) {
 		//every pass through the game loop creates one frame of output
 		//  by performing three steps:
+		TRACE_ZONE("frame");
+		auto frame_start = std::chrono::steady_clock::now();
+		Uint32 oldest_input = 0; //SDL timestamp (ms) of the first input event handled this frame
+		bool had_input = false;
+
+		//per-frame bookkeeping only advances once the last pass actually drew a frame
+		// (throttled passes that skip drawing fold into the next frame that is drawn):
+		if (frame_produced) {
+			frame_produced = false;
+			//per-frame scratch memory from last frame is no longer in use:
+			frame_arena.reset();
+			//start counting this frame's GL state changes:
+			gl_state.begin_frame();
+			//snapshot last frame's counters for the HUD:
+			counters.begin_frame();
+			//read back GPU timings from a few frames ago:
+			gpu_profiler->begin_frame();
+			//count last frame's heap allocations per tag:
+			alloc_tracking_begin_frame();
+		}
+		//see if the GPU has finished any frames that consumed input:
+		latency->poll();
+
+		//start (or stop) the simulation thread when the current mode changes:
+		if ((sim ? sim->mode.get() : nullptr) != Mode::current.get()) {
+			sim.reset();
+			float rate = Mode::current->simulation_rate();
+			if (rate > 0.0f) sim.reset(new SimThread(Mode::current, rate));
+		}
+
+		bool throttled = !window_visible || !window_focused || Mode::current->scene_unchanged();
+
+		//don't get too far ahead of the GPU, and (in lowest latency mode) sample input as late as possible:
+		if (!throttled) pacer->wait_before_input();
+		auto work_start = std::chrono::steady_clock::now();
 
 		{ //(1) process any events that are pending
+			TRACE_ZONE("events");
+			ALLOC_TAG(AllocInput);
 			static SDL_Event evt;
-			while (SDL_PollEvent(&evt) == 1) {
+			//when throttled, sleep until an event arrives or it is time for the next idle frame:
+			int have_event;
+			if (throttled) {
+				auto wait = std::chrono::duration_cast< std::chrono::milliseconds >(next_idle_frame - work_start).count();
+				have_event = SDL_WaitEventTimeout(&evt, int(std::max< int64_t >(1, wait)));
+			} else {
+				have_event = SDL_PollEvent(&evt);
+			}
+			for ( ; have_event == 1; have_event = SDL_PollEvent(&evt)) {
+				//note input age (for frame metrics):
+				if (!had_input && (evt.type == SDL_KEYDOWN || evt.type == SDL_KEYUP || evt.type == SDL_MOUSEMOTION
+				 || evt.type == SDL_MOUSEBUTTONDOWN || evt.type == SDL_MOUSEBUTTONUP)) {
+					oldest_input = evt.common.timestamp;
+					had_input = true;
+				}
+				if (evt.type == SDL_MOUSEMOTION) {
+					latency->motion(evt.motion.timestamp);
+				}
 				//handle resizing:
 				if (evt.type == SDL_WINDOWEVENT && evt.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
 					on_resize();
 				}
-				//handle input:
-				if (Mode::current && Mode::current->handle_event(evt, window_size)) {
+				//track visibility and focus (for throttling):
+				if (evt.type == SDL_WINDOWEVENT) {
+					switch (evt.window.event) {
+						case SDL_WINDOWEVENT_HIDDEN:
+						case SDL_WINDOWEVENT_MINIMIZED:
+							window_visible = false;
+							break;
+						case SDL_WINDOWEVENT_SHOWN:
+						case SDL_WINDOWEVENT_RESTORED:
+						case SDL_WINDOWEVENT_MAXIMIZED:
+						case SDL_WINDOWEVENT_EXPOSED:
+							window_visible = true;
+							needs_redraw = true;
+							break;
+						case SDL_WINDOWEVENT_FOCUS_GAINED:
+							window_focused = true;
+							break;
+						case SDL_WINDOWEVENT_FOCUS_LOST:
+							window_focused = false;
+							break;
+					}
+				}
+				//high polling rate mice queue many motion events per frame; fold the rest of this run into this one:
+				// (the simulation thread applies each input at its timestamp, so only merge same-timestamp events for it)
+				if (evt.type == SDL_MOUSEMOTION && Mode::current && !Mode::current->wants_every_motion_event()) {
+					SDL_Event next;
+					while (SDL_PeepEvents(&next, 1, SDL_PEEKEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT) == 1
+					 && next.type == SDL_MOUSEMOTION && next.motion.which == evt.motion.which
+					 && (!sim || next.motion.timestamp == evt.motion.timestamp)) {
+						SDL_PeepEvents(&next, 1, SDL_GETEVENT, SDL_MOUSEMOTION, SDL_MOUSEMOTION);
+						evt.motion.timestamp = next.motion.timestamp;
+						evt.motion.state = next.motion.state;
+						evt.motion.x = next.motion.x;
+						evt.motion.y = next.motion.y;
+						evt.motion.xrel += next.motion.xrel;
+						evt.motion.yrel += next.motion.yrel;
+						motion_events_merged.add(1);
+					}
+				}
+				//with no evdev access, raw mouse motion comes from SDL's relative mode instead:
+				if (evt.type == SDL_MOUSEMOTION && raw_mouse->source == RawMouse::SDLRelative) {
+					raw_mouse->add(evt.motion.xrel, evt.motion.yrel);
+				}
+				//handle input (a mode on the simulation thread gets every event there, and can't claim any):
+				if (sim) sim->push(evt, window_size);
+				if (!sim && Mode::current && Mode::current->handle_event(evt, window_size)) {
 					// mode handled it; great
 				} else if (evt.type == SDL_QUIT) {
 					Mode::set_current(nullptr);
 					break;
 				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_PRINTSCREEN) {
 					// --- screenshot key ---
-					std::string filename = "screenshot.png";
-					std::cout << "Saving screenshot to '" << filename << "'." << std::endl;
-					glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-					glReadBuffer(GL_FRONT);
-					int w,h;
-					SDL_GL_GetDrawableSize(window, &w, &h);
-					std::vector< glm::u8vec4 > data(w*h);
-					glReadPixels(0,0,w,h, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
-					for (auto &px : data) {
-						px.a = 0xff;
+					//(the next frame drawn is read back once it's finished)
+					screenshot_requested = true;
+					needs_redraw = true;
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F3) {
+					// --- GPU profiler overlay key ---
+					gpu_profiler->show_overlay = !gpu_profiler->show_overlay;
+					#ifndef NDEBUG
+					steady_frames = 0; //(overlay may grow the renderer's buffers)
+					#endif
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F1) {
+					// --- counters HUD key ---
+					debug_hud.show = !debug_hud.show;
+					#ifndef NDEBUG
+					steady_frames = 0; //(HUD may grow the renderer's buffers)
+					#endif
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F2) {
+					// --- trace dump key ---
+					write_trace();
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F4) {
+					// --- frame time percentiles key ---
+					metrics->report(std::cout);
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F6) {
+					// --- latency measurement key ---
+					latency->enabled = !latency->enabled;
+					std::cout << "Latency measurement " << (latency->enabled ? "on" : "off") << " (swap interval " << SDL_GL_GetSwapInterval() << ")." << std::endl;
+					if (!latency->enabled) latency->report(std::cout);
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F7) {
+					// --- frame pacing mode key ---
+					pacer->set_mode(pacer->mode == FramePacer::LowestLatency ? FramePacer::MaxThroughput : FramePacer::LowestLatency);
+					std::cout << "Frame pacing: " << (pacer->mode == FramePacer::LowestLatency ? "lowest latency" : "max throughput")
+					          << ", " << pacer->frames_ahead << " frame(s) ahead." << std::endl;
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F8) {
+					// --- frames ahead key ---
+					pacer->frames_ahead = (pacer->frames_ahead + 1) % (FramePacer::MaxFramesAhead + 1);
+					std::cout << "Frame pacing: " << pacer->frames_ahead << " frame(s) ahead." << std::endl;
+				} else if (evt.type == SDL_KEYDOWN && (evt.key.keysym.sym == SDLK_F10 || evt.key.keysym.sym == SDLK_F11)) {
+					// --- recording keys ---
+					if (capture->recording()) {
+						capture->stop_recording();
+					} else {
+						capture->backpressure = (evt.key.keysym.mod & KMOD_SHIFT) ? FrameCapture::WaitForEncoders : FrameCapture::DropFrames;
+						if (evt.key.keysym.sym == SDLK_F10) {
+							capture->start_recording(FrameCapture::PNGSequence, "recording", 0);
+						} else {
+							//(the stream plays back at the display's rate, which is what the pacer aims for)
+							capture->start_recording(FrameCapture::Y4M, "recording", uint32_t(1.0e6f / pacer->vsync_period_us + 0.5f));
+						}
+					}
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F9) {
+					// --- raw mouse key ---
+					if (raw_mouse->source != RawMouse::None) {
+						raw_mouse->stop();
+						SDL_SetRelativeMouseMode(SDL_FALSE);
+						std::cout << "Raw mouse off." << std::endl;
+					} else {
+						if (!raw_mouse->start()) raw_mouse->start_sdl_relative();
+						//(keeps the system cursor from wandering off while motion is read raw)
+						SDL_SetRelativeMouseMode(SDL_TRUE);
+						std::cout << "Raw mouse on (" << (raw_mouse->source == RawMouse::Evdev ? "evdev thread" : "SDL relative mode") << ")." << std::endl;
 					}
-					save_png(filename, glm::uvec2(w,h), data.data(), LowerLeftOrigin);
 				}
 			}
 			if (!Mode::current) break;
 		}
 
-		{ //(2) call the current mode's "update" function to deal with elapsed time:
+		//(events may have changed things; e.g., input that un-pauses the scene)
+		throttled = !window_visible || !window_focused || Mode::current->scene_unchanged();
+		//(raw motion made while another window has focus isn't meant for this one)
+		raw_mouse->set_paused(!window_visible || !window_focused);
+		if (sim) sim->throttled = throttled;
+		if (throttled) {
+			//events alone don't advance a throttled loop; only the idle frame rate (or a needed redraw) does:
+			auto now = std::chrono::steady_clock::now();
+			if (now < next_idle_frame && !(needs_redraw && window_visible)) continue;
+			next_idle_frame = now + idle_frame_time;
+		}
+
+		//start encoding finished screenshot and recording readbacks:
+		//(after the throttle check, so idle frames still finish them but event wakeups don't poll)
+		capture->poll();
+
+		auto update_start = std::chrono::steady_clock::now();
+
+		if (!sim) { //(2) call the current mode's "update" function to deal with elapsed time:
+			// (modes with a simulation thread update there instead)
+			TRACE_ZONE("update");
+			PerfZone perf(update_perf);
+			ALLOC_TAG(AllocSim);
 			auto current_time = std::chrono::high_resolution_clock::now();
 			static auto previous_time = current_time;
 			float elapsed = std::chrono::duration< float >(current_time - previous_time).count();
@@ -157,24 +460,111 @@ int main(int argc, char **argv) {
 			if (!Mode::current) break;
 		}
 
+		if (Mode::current->finished) {
+			Mode::set_current(nullptr);
+			break;
+		}
+
+		//nothing to show (or no one to show it to); skip draw and swap:
+		if (!window_visible || (Mode::current->scene_unchanged() && !needs_redraw)) continue;
+		needs_redraw = false;
+
+		auto draw_start = std::chrono::steady_clock::now();
+
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+			TRACE_ZONE("draw");
+			PerfZone perf(draw_perf);
+			ALLOC_TAG(AllocRender);
+
 			Mode::current->draw(drawable_size);
+
+			//GPU pass timings and counters, drawn over the mode:
+			gpu_profiler->draw_overlay(drawable_size);
+			debug_hud.draw(drawable_size);
+
+			if (screenshot_requested) {
+				capture->screenshot(drawable_size, "screenshot.png");
+				screenshot_requested = false;
+			}
+			capture->frame_drawn(drawable_size);
+
+			#ifndef NDEBUG
+			//after a few warm-up frames, scratch storage should have grown to fit:
+			if (Mode::current.get() != steady_mode) {
+				steady_mode = Mode::current.get();
+				steady_frames = 0;
+			}
+			steady_frames += 1;
+			assert((steady_frames <= 10 || frame_arena.frame_heap_allocations == 0) && "steady-state frame allocated scratch memory");
+			#endif
+		}
+
+		auto swap_start = std::chrono::steady_clock::now();
+
+		{ //Wait until the recently-drawn frame is shown before doing it all again:
+			TRACE_ZONE("swap");
+			SDL_GL_SwapWindow(window);
+			latency->frame_swapped(update_start, draw_start);
+			pacer->frame_swapped(work_start, swap_start);
+			frame_produced = true;
 		}
 
-		//Wait until the recently-drawn frame is shown before doing it all again:
-		SDL_GL_SwapWindow(window);
+		{ //record this frame's timings:
+			auto frame_end = std::chrono::steady_clock::now();
+			FrameRecord record;
+			record.frame = frame_number++;
+			record.start_ns = ns_between(session_start, frame_start);
+			record.update_ns = ns_saturated(ns_between(update_start, draw_start));
+			record.draw_ns = ns_saturated(ns_between(draw_start, swap_start));
+			record.swap_ns = ns_saturated(ns_between(swap_start, frame_end));
+			record.total_ns = ns_saturated(ns_between(frame_start, frame_end));
+			if (had_input) {
+				//(SDL timestamps are only millisecond-accurate)
+				record.input_age_ns = ns_saturated(uint64_t(std::max< Uint32 >(1, SDL_GetTicks() - oldest_input)) * 1000000u);
+			}
+			metrics->record(record);
+		}
 	}
 
 
 	//------------  teardown ------------
 
+	sim.reset();
+
+	//(after the simulation thread, which samples it)
+	raw_mouse = nullptr;
+	raw.reset();
+
+	metrics->report(std::cout);
+	metrics.reset();
+
+	perf_counters_report(std::cout);
+	perf_counters_close();
+
+	alloc_tracking_report(std::cout);
+
+	if (latency->swap.count) latency->report(std::cout);
+	latency.reset();
+	pacer.reset();
+	capture.reset();
+
+	write_trace();
+
+	gpu_profiler = nullptr;
+	profiler.reset();
+
+	batch_renderer = nullptr;
+	renderer.reset();
+
 	SDL_GL_DeleteContext(context);
 	context = 0;
 
 	SDL_DestroyWindow(window);
 	window = NULL;
 
+	jobs = nullptr;
+	job_system.reset();
+
 	return 0;
 
 #ifdef _WIN32
@@ -0,0 +1,192 @@
+#include "perf_counters.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <mutex>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+//zones register here during static initialization (so this must be constant-initialized):
+constexpr uint32_t MaxZones = 16;
+PerfZoneStats *zones[MaxZones];
+uint32_t zone_count = 0;
+
+//some thread has opened a group (so there is something to report):
+std::atomic< bool > available{false};
+//a group only counts the thread that opened it, so each thread opens its own:
+thread_local bool opened_here = false;
+
+#ifdef __linux__
+//this thread's group, leader first:
+thread_local int fds[4] = { -1, -1, -1, -1 };
+uint64_t const configs[4] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES,
+	PERF_COUNT_HW_BRANCH_MISSES,
+};
+#endif
+
+} //namespace
+
+PerfZoneStats::PerfZoneStats(char const *name_) : name(name_) {
+	std::memset(hud_names, 0, sizeof(hud_names));
+	if (zone_count < MaxZones) zones[zone_count++] = this;
+}
+
+bool perf_counters_available() {
+	return opened_here;
+}
+
+#ifdef __linux__
+
+bool perf_counters_open() {
+	if (opened_here) return true;
+
+	for (uint32_t i = 0; i < 4; ++i) {
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = configs[i];
+		attr.disabled = (i == 0 ? 1 : 0); //the whole group starts when the leader is enabled
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		//this thread, any cpu:
+		fds[i] = int(syscall(SYS_perf_event_open, &attr, 0, -1, (i == 0 ? -1 : fds[0]), 0));
+		if (fds[i] < 0) {
+			//(say so once, not once per thread)
+			static std::atomic< bool > noted{false};
+			if (!noted.exchange(true)) {
+				std::cerr << "NOTE: hardware performance counters unavailable (perf_event_open: " << std::strerror(errno) << "); not collecting them." << std::endl;
+			}
+			perf_counters_close();
+			return false;
+		}
+	}
+	ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	opened_here = true;
+
+	//publish per-frame values for every zone on the HUD (once, by whichever thread gets here first):
+	static std::once_flag registered;
+	std::call_once(registered, [](){
+		static char const *suffixes[4] = { "cyc", "ins", "cache miss", "br miss" };
+		for (uint32_t z = 0; z < zone_count; ++z) {
+			PerfZoneStats &zone = *zones[z];
+			for (uint32_t i = 0; i < 4; ++i) {
+				std::snprintf(zone.hud_names[i], sizeof(zone.hud_names[i]), "%s %s", zone.name, suffixes[i]);
+				zone.hud[i] = &counters.add(zone.hud_names[i]);
+			}
+		}
+		available = true;
+	});
+	return true;
+}
+
+void perf_counters_close() {
+	//members first, then the leader:
+	for (int32_t i = 3; i >= 0; --i) {
+		if (fds[i] >= 0) close(fds[i]);
+		fds[i] = -1;
+	}
+	opened_here = false;
+}
+
+PerfSample perf_counters_read() {
+	PerfSample sample;
+	if (!opened_here) return sample;
+
+	//PERF_FORMAT_GROUP layout: nr, time_enabled, time_running, value[nr]
+	uint64_t data[3 + 4];
+	if (read(fds[0], data, sizeof(data)) != ssize_t(sizeof(data)) || data[0] != 4) return sample;
+
+	//the kernel time-slices groups when there are more counters than hardware slots; scale up:
+	double scale = (data[2] && data[2] < data[1] ? double(data[1]) / double(data[2]) : 1.0);
+	sample.cycles = uint64_t(data[3] * scale);
+	sample.instructions = uint64_t(data[4] * scale);
+	sample.cache_misses = uint64_t(data[5] * scale);
+	sample.branch_misses = uint64_t(data[6] * scale);
+	return sample;
+}
+
+#else //not linux
+
+bool perf_counters_open() {
+	return false;
+}
+
+void perf_counters_close() {
+}
+
+PerfSample perf_counters_read() {
+	return PerfSample();
+}
+
+#endif
+
+PerfZone::PerfZone(PerfZoneStats &stats_) : stats(opened_here ? &stats_ : nullptr) {
+	if (stats) begin = perf_counters_read();
+}
+
+void PerfZone::stop() {
+	if (!stats) return;
+	PerfSample end = perf_counters_read();
+	uint64_t delta[4] = {
+		end.cycles - begin.cycles,
+		end.instructions - begin.instructions,
+		end.cache_misses - begin.cache_misses,
+		end.branch_misses - begin.branch_misses,
+	};
+	stats->total.cycles += delta[0];
+	stats->total.instructions += delta[1];
+	stats->total.cache_misses += delta[2];
+	stats->total.branch_misses += delta[3];
+	stats->entries += 1;
+	for (uint32_t i = 0; i < 4; ++i) {
+		if (stats->hud[i]) stats->hud[i]->add(delta[i]);
+	}
+	stats = nullptr;
+}
+
+void perf_counters_report(std::ostream &out) {
+	if (!available) return;
+
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+	out << std::fixed;
+
+	out << "Hardware counters per zone entry:\n";
+	for (uint32_t z = 0; z < zone_count; ++z) {
+		PerfZoneStats const &zone = *zones[z];
+		if (!zone.entries) continue;
+		double n = double(zone.entries);
+		double kilo_instructions = std::max(1.0, zone.total.instructions / 1000.0);
+		out << "  " << std::setw(10) << std::left << zone.name << std::right
+		    << std::setprecision(0)
+		    << " cycles " << std::setw(9) << zone.total.cycles / n
+		    << "  instructions " << std::setw(9) << zone.total.instructions / n
+		    << std::setprecision(2)
+		    << "  IPC " << (zone.total.cycles ? double(zone.total.instructions) / zone.total.cycles : 0.0)
+		    << "  cache MPKI " << zone.total.cache_misses / kilo_instructions
+		    << "  branch MPKI " << zone.total.branch_misses / kilo_instructions
+		    << "  (" << zone.entries << " entries)\n";
+	}
+	//(low IPC with high cache MPKI suggests a memory-bound zone; high IPC, a compute-bound one)
+
+	out.flags(flags);
+	out.precision(precision);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "counters.hpp"
+
+#include <iosfwd>
+#include <stdint.h>
+
+/*
+ * Hardware performance counters (cycles, instructions, cache misses, branch
+ *  misses) around named zones, read as one perf_event_open group so all four
+ *  values cover exactly the same interval.
+ *
+ *   static PerfZoneStats collision_perf("collisions");
+ *   ...
+ *   PerfZone perf(collision_perf);
+ *
+ * Each thread that wants its zones counted calls perf_counters_open() (the
+ *  main thread and the simulation thread do); zones entered on other threads
+ *  (JobSystem workers) aren't counted. A zone's totals aren't synchronized,
+ *  so each zone should only be entered on one thread at a time.
+ * Linux only; elsewhere -- or when the kernel refuses,
+ *  e.g. because of perf_event_paranoid or a VM without a PMU -- nothing is
+ *  collected and zones cost one branch.
+ */
+
+struct PerfSample {
+	uint64_t cycles = 0;
+	uint64_t instructions = 0;
+	uint64_t cache_misses = 0;
+	uint64_t branch_misses = 0;
+};
+
+struct PerfZoneStats {
+	//registers the zone for perf_counters_report(); construct at file scope:
+	PerfZoneStats(char const *name);
+
+	char const *name;
+	PerfSample total; //summed over every entry
+	uint64_t entries = 0;
+
+	//per-frame values shown on the debug HUD (registered by perf_counters_open()):
+	Counter *hud[4] = { nullptr, nullptr, nullptr, nullptr };
+	char hud_names[4][24];
+};
+
+//opens (or closes) the counter group for the calling thread; prints a note (once) and returns false if unavailable:
+bool perf_counters_open();
+void perf_counters_close();
+//true if the calling thread's group is open:
+bool perf_counters_available();
+
+//current totals for the calling thread's group (all zero if unavailable):
+PerfSample perf_counters_read();
+
+//per-entry averages, IPC, and misses per thousand instructions for every zone that ran:
+void perf_counters_report(std::ostream &out);
+
+struct PerfZone {
+	PerfZone(PerfZoneStats &stats_);
+	~PerfZone() { stop(); }
+	PerfZone(PerfZone const &) = delete;
+	PerfZone &operator=(PerfZone const &) = delete;
+
+	//end the zone early (later calls do nothing):
+	void stop();
+
+	PerfZoneStats *stats; //nullptr if not counting
+	PerfSample begin;
+};
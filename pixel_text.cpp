@@ -0,0 +1,90 @@
+#include "pixel_text.hpp"
+
+#include "BatchRenderer.hpp"
+
+#include <stdint.h>
+
+//glyphs are five rows of three bits, top row in the high bits:
+#define GLYPH(R0, R1, R2, R3, R4) uint16_t(((R0) << 12) | ((R1) << 9) | ((R2) << 6) | ((R3) << 3) | (R4))
+
+static uint16_t glyph_bits(char c) {
+	if (c >= 'a' && c <= 'z') c = char(c - 'a' + 'A');
+	switch (c) {
+	case 'A': return GLYPH(2,5,7,5,5);
+	case 'B': return GLYPH(6,5,6,5,6);
+	case 'C': return GLYPH(3,4,4,4,3);
+	case 'D': return GLYPH(6,5,5,5,6);
+	case 'E': return GLYPH(7,4,6,4,7);
+	case 'F': return GLYPH(7,4,6,4,4);
+	case 'G': return GLYPH(3,4,5,5,3);
+	case 'H': return GLYPH(5,5,7,5,5);
+	case 'I': return GLYPH(7,2,2,2,7);
+	case 'J': return GLYPH(1,1,1,5,2);
+	case 'K': return GLYPH(5,5,6,5,5);
+	case 'L': return GLYPH(4,4,4,4,7);
+	case 'M': return GLYPH(5,7,7,5,5);
+	case 'N': return GLYPH(6,5,5,5,5);
+	case 'O': return GLYPH(2,5,5,5,2);
+	case 'P': return GLYPH(6,5,6,4,4);
+	case 'Q': return GLYPH(2,5,5,6,3);
+	case 'R': return GLYPH(6,5,6,5,5);
+	case 'S': return GLYPH(3,4,2,1,6);
+	case 'T': return GLYPH(7,2,2,2,2);
+	case 'U': return GLYPH(5,5,5,5,7);
+	case 'V': return GLYPH(5,5,5,5,2);
+	case 'W': return GLYPH(5,5,7,7,5);
+	case 'X': return GLYPH(5,5,2,5,5);
+	case 'Y': return GLYPH(5,5,2,2,2);
+	case 'Z': return GLYPH(7,1,2,4,7);
+	case '0': return GLYPH(7,5,5,5,7);
+	case '1': return GLYPH(2,6,2,2,7);
+	case '2': return GLYPH(6,1,2,4,7);
+	case '3': return GLYPH(6,1,2,1,6);
+	case '4': return GLYPH(5,5,7,1,1);
+	case '5': return GLYPH(7,4,6,1,6);
+	case '6': return GLYPH(3,4,7,5,7);
+	case '7': return GLYPH(7,1,2,2,2);
+	case '8': return GLYPH(7,5,7,5,7);
+	case '9': return GLYPH(7,5,7,1,6);
+	case ' ': return 0;
+	case '.': return GLYPH(0,0,0,0,2);
+	case ':': return GLYPH(0,2,0,2,0);
+	case '-': return GLYPH(0,0,7,0,0);
+	case '/': return GLYPH(1,1,2,4,4);
+	case '%': return GLYPH(5,1,2,4,5);
+	}
+	return GLYPH(7,7,7,7,7);
+}
+
+#undef GLYPH
+
+//font pixels per character (glyph width plus spacing):
+static constexpr float Advance = 4.0f;
+
+float draw_pixel_text(glm::vec2 const &at, float scale, char const *text, glm::u8vec4 const &color) {
+	float x = at.x;
+	for (char const *c = text; *c; ++c) {
+		uint16_t bits = glyph_bits(*c);
+		for (uint32_t row = 0; row < 5; ++row) {
+			uint32_t line = (bits >> (3 * (4 - row))) & 7;
+			//one quad per horizontal run of lit pixels:
+			for (uint32_t col = 0; col < 3; ) {
+				if (!(line & (4 >> col))) { ++col; continue; }
+				uint32_t end = col;
+				while (end < 3 && (line & (4 >> end))) ++end;
+				glm::vec2 min(x + col * scale, at.y - (row + 1) * scale);
+				glm::vec2 max(x + end * scale, at.y - row * scale);
+				batch_renderer->quad(0.5f * (min + max), 0.5f * (max - min), color);
+				col = end;
+			}
+		}
+		x += Advance * scale;
+	}
+	return x;
+}
+
+float pixel_text_width(float scale, char const *text) {
+	uint32_t count = 0;
+	while (text[count]) ++count;
+	return count * Advance * scale;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/*
+ * Tiny 3x5 pixel font for debug overlays, drawn as quads through batch_renderer
+ *  (call between batch_renderer->begin() and flush()).
+ *
+ * Covers A-Z (lowercase is drawn as uppercase), 0-9, and " .:-/%"; other
+ *  characters draw as a filled box.
+ */
+
+//draws 'text' with its upper left corner at 'at', 'scale' units per font pixel;
+// returns the x coordinate just past the last character:
+float draw_pixel_text(glm::vec2 const &at, float scale, char const *text, glm::u8vec4 const &color);
+
+//width of 'text' as drawn by draw_pixel_text:
+float pixel_text_width(float scale, char const *text);
+
+//font pixels per line (glyph height plus spacing):
+constexpr float PixelTextLineHeight = 7.0f;
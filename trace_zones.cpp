@@ -0,0 +1,120 @@
+#include "trace_zones.hpp"
+
+#ifdef ENABLE_TRACE_ZONES
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+//zones kept per thread (24 bytes each):
+constexpr uint64_t TraceCapacity = 1 << 15;
+
+//fields are relaxed atomics so trace_write can read a ring while its thread writes it:
+struct TraceEvent {
+	std::atomic< char const * > name{nullptr};
+	std::atomic< uint64_t > begin{0};
+	std::atomic< uint64_t > end{0};
+};
+
+struct TraceThread {
+	uint32_t tid = 0;
+	std::string name; //guarded by registry_mutex
+	std::atomic< uint64_t > written{0}; //total zones ever recorded; only the owning thread stores it
+	TraceEvent events[TraceCapacity];
+};
+
+//every thread that has recorded a zone; rings outlive their threads so they can still be written out:
+std::mutex registry_mutex;
+std::vector< std::unique_ptr< TraceThread > > registry;
+
+TraceThread *this_thread_trace() {
+	thread_local TraceThread *trace = nullptr;
+	if (!trace) {
+		std::unique_ptr< TraceThread > created(new TraceThread);
+		std::lock_guard< std::mutex > lock(registry_mutex);
+		created->tid = uint32_t(registry.size()) + 1;
+		created->name = "thread " + std::to_string(created->tid);
+		trace = created.get();
+		registry.emplace_back(std::move(created));
+	}
+	return trace;
+}
+
+} //namespace
+
+uint64_t trace_now() {
+	static const auto epoch = std::chrono::steady_clock::now();
+	return uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - epoch).count());
+}
+
+void trace_record(char const *name, uint64_t begin, uint64_t end) {
+	TraceThread *trace = this_thread_trace();
+	uint64_t index = trace->written.load(std::memory_order_relaxed);
+	TraceEvent &event = trace->events[index % TraceCapacity];
+	event.name.store(name, std::memory_order_relaxed);
+	event.begin.store(begin, std::memory_order_relaxed);
+	event.end.store(end, std::memory_order_relaxed);
+	trace->written.store(index + 1, std::memory_order_release);
+}
+
+void trace_thread_name(char const *name) {
+	TraceThread *trace = this_thread_trace();
+	std::lock_guard< std::mutex > lock(registry_mutex);
+	trace->name = name;
+}
+
+bool trace_write(std::string const &filename) {
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) return false;
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	out << std::fixed << std::setprecision(3);
+	bool first = true;
+	auto separator = [&]() {
+		if (!first) out << ",\n";
+		first = false;
+	};
+
+	std::lock_guard< std::mutex > lock(registry_mutex);
+	for (auto const &trace : registry) {
+		separator();
+		out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << trace->tid
+		    << ",\"args\":{\"name\":\"" << trace->name << "\"}}";
+
+		//copy the ring, then throw away anything its thread may have overwritten meanwhile:
+		uint64_t written = trace->written.load(std::memory_order_acquire);
+		uint64_t oldest = (written > TraceCapacity ? written - TraceCapacity : 0);
+		std::vector< uint64_t > begins, ends;
+		std::vector< char const * > names;
+		for (uint64_t i = oldest; i < written; ++i) {
+			TraceEvent const &event = trace->events[i % TraceCapacity];
+			names.emplace_back(event.name.load(std::memory_order_relaxed));
+			begins.emplace_back(event.begin.load(std::memory_order_relaxed));
+			ends.emplace_back(event.end.load(std::memory_order_relaxed));
+		}
+		uint64_t after = trace->written.load(std::memory_order_acquire);
+		//(the writer may be part-way through slot 'after', which held zone 'after - TraceCapacity')
+		uint64_t valid = (after >= TraceCapacity ? after - TraceCapacity + 1 : 0);
+
+		for (uint64_t i = std::max(oldest, valid); i < written; ++i) {
+			size_t at = size_t(i - oldest);
+			separator();
+			//(names are string literals in this codebase, so they don't need escaping)
+			out << "{\"name\":\"" << names[at] << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << trace->tid
+			    << ",\"ts\":" << begins[at] * 1.0e-3
+			    << ",\"dur\":" << (ends[at] - begins[at]) * 1.0e-3 << "}";
+		}
+	}
+	out << "\n]}\n";
+
+	return bool(out);
+}
+
+#endif //ENABLE_TRACE_ZONES
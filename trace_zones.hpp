@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+/*
+ * Scoped CPU timing zones, exported as Chrome trace_event JSON
+ *  (open the file in chrome://tracing or https://ui.perfetto.dev).
+ *
+ *   void Thing::update() {
+ *       TRACE_ZONE("Thing::update");
+ *       ...
+ *   }
+ *
+ * Zones compile to nothing unless ENABLE_TRACE_ZONES is defined (the Jamfile
+ *  defines it). Each thread records into its own fixed-size ring that only it
+ *  writes, so recording takes no locks; once a ring is full, its oldest zones
+ *  are overwritten.
+ */
+
+#ifdef ENABLE_TRACE_ZONES
+
+//nanoseconds since the first call:
+uint64_t trace_now();
+
+//called by TraceZone; 'name' must be a string literal (only the pointer is kept):
+void trace_record(char const *name, uint64_t begin, uint64_t end);
+
+//label the calling thread in the trace (otherwise it is "thread N"):
+void trace_thread_name(char const *name);
+
+//write every thread's recorded zones to 'filename'; returns false on failure:
+bool trace_write(std::string const &filename);
+
+struct TraceZone {
+	TraceZone(char const *name_) : name(name_), begin(trace_now()) { }
+	~TraceZone() { trace_record(name, begin, trace_now()); }
+	TraceZone(TraceZone const &) = delete;
+	TraceZone &operator=(TraceZone const &) = delete;
+	char const *name;
+	uint64_t begin;
+};
+
+#define TRACE_ZONE_NAME2(LINE) trace_zone_ ## LINE
+#define TRACE_ZONE_NAME(LINE) TRACE_ZONE_NAME2(LINE)
+#define TRACE_ZONE(NAME) TraceZone TRACE_ZONE_NAME(__LINE__)(NAME)
+
+#else //ENABLE_TRACE_ZONES
+
+inline void trace_thread_name(char const *) { }
+inline bool trace_write(std::string const &) { return false; }
+
+#define TRACE_ZONE(NAME) do { } while (0)
+
+#endif //ENABLE_TRACE_ZONES